@@ -0,0 +1,291 @@
+/**
+ * @file armDispatcher.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the dispatcher assigning the blocks to the arms working on the same table
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Every arm has a queue of the blocks assigned to it and the estimated time it will be done with them. A block is
+ * assigned to the arm that would complete it first, given the order it is executing, its queue and the time of the
+ * pick cycle from its own base. The arms are identical UR5s, the base of each one is shifted on the table by an offset
+ * from the base used by the cycle time model, and so is the area where it can pick the blocks. A block is only assigned
+ * to the arms reaching it and whose move node takes its orders.
+ * Needs pickOrder.cpp to be included before this file.
+ */
+
+#include <iostream>
+#include <Eigen/Dense>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+using namespace std;
+using Eigen::Vector3f;
+
+///World frame area where the arm of the single arm cell picks the blocks, shifted by the base offset for the other arms [m]
+#define PICK_MIN_X 0.05
+#define PICK_MAX_X 0.5
+#define PICK_MIN_Y 0.05
+#define PICK_MAX_Y 0.75
+
+/**
+ * @brief Struct to store a block assigned to an arm
+ *
+ */
+struct ArmTask{
+    int blockId;
+    float cycle; // estimated time of the pick cycle [s]
+};
+
+/**
+ * @brief Struct to store the state of an arm
+ *
+ */
+struct ArmState{
+    Vector3f baseOffset; // world frame offset of the base from the base of the cycle time model
+    int blockInTransit; // block of the order being executed, -1 if idle
+    double busyUntil; // estimated end of the order being executed [s]
+    deque<ArmTask> queue; // blocks assigned and not ordered yet
+    int completed; // orders completed since the start
+    bool offline; // the move node did not take its orders, no block is assigned to the arm
+};
+
+/**
+ * @brief Dispatcher of the blocks between the arms
+ *
+ */
+class ArmDispatcher{
+public:
+    int addArm(Vector3f baseOffset); // Add an arm and return its index
+    int arms() const;
+    ArmState& arm(int index);
+
+    bool reaches(int arm, Vector3f blockPos) const; // True if a block is in the pick area of an arm
+    float cycleTime(int arm, Vector3f blockPos, Vector3f targetPos) const; // Estimated pick cycle of a block for an arm
+    int assign(int blockId, Vector3f blockPos, Vector3f targetPos, double now); // Assign a block to the arm reaching it that completes it first
+    int next(int arm); // Pop the next block assigned to an arm, -1 if none
+    void clearQueues(); // Remove the blocks assigned and not ordered yet
+    void started(int arm, int blockId, float cycle, double now); // Record an order sent to an arm
+    int completed(int blockId, double now); // Record the end of the order of a block and return its arm, -1 if unknown
+    int withdraw(int arm, double now); // Take back the order of an arm without completing it, return its block
+    void setOffline(int arm, bool offline); // Stop or resume assigning blocks to an arm
+    int armOf(int blockId) const; // Arm moving a block, -1 if none
+    bool idle() const; // True if no arm has an order or a block assigned
+
+private:
+    vector<ArmState> state;
+
+    double completionTime(int arm, double now) const; // Estimated time an arm is done with its queue
+};
+
+/**
+ * @brief Add an idle arm
+ *
+ * @param baseOffset world frame offset of its base from the base of the cycle time model
+ * @return int index of the arm
+ */
+int ArmDispatcher::addArm(Vector3f baseOffset){
+    ArmState arm;
+    arm.baseOffset = baseOffset;
+    arm.blockInTransit = -1;
+    arm.busyUntil = 0;
+    arm.completed = 0;
+    arm.offline = false;
+    state.push_back(arm);
+    return state.size() - 1;
+}
+
+/**
+ * @brief Number of arms
+ *
+ * @return int
+ */
+int ArmDispatcher::arms() const{
+    return state.size();
+}
+
+/**
+ * @brief State of an arm
+ *
+ * @param index
+ * @return ArmState&
+ */
+ArmState& ArmDispatcher::arm(int index){
+    return state[index];
+}
+
+/**
+ * @brief True if a block is in the pick area of an arm
+ *
+ * @param arm
+ * @param blockPos world frame
+ * @return true
+ * @return false
+ */
+bool ArmDispatcher::reaches(int arm, Vector3f blockPos) const{
+    Vector3f local = blockPos - state[arm].baseOffset;
+    return local(0) > PICK_MIN_X && local(0) < PICK_MAX_X && local(1) > PICK_MIN_Y && local(1) < PICK_MAX_Y;
+}
+
+/**
+ * @brief Estimated time of the pick cycle of a block for an arm, the positions are moved in the frame of the cycle time model
+ *
+ * @param arm
+ * @param blockPos world frame
+ * @param targetPos world frame
+ * @return float [s]
+ */
+float ArmDispatcher::cycleTime(int arm, Vector3f blockPos, Vector3f targetPos) const{
+    Vector3f offset = state[arm].baseOffset;
+    return estimatePickCycle(homePosition(), blockPos - offset, targetPos - offset).time;
+}
+
+/**
+ * @brief Estimated time an arm is done with the order it is executing and with its queue
+ *
+ * @param arm
+ * @param now [s]
+ * @return double [s]
+ */
+double ArmDispatcher::completionTime(int arm, double now) const{
+    double time = max(now, state[arm].busyUntil);
+    for(int i = 0; i < state[arm].queue.size(); i++)
+        time += state[arm].queue[i].cycle;
+    return time;
+}
+
+/**
+ * @brief Assign a block to the arm that would complete it first among the arms reaching it and online, ties go to the arm
+ * with the lowest index
+ *
+ * @param blockId
+ * @param blockPos world frame
+ * @param targetPos world frame, estimated
+ * @param now [s]
+ * @return int index of the arm, -1 if no arm reaches the block
+ */
+int ArmDispatcher::assign(int blockId, Vector3f blockPos, Vector3f targetPos, double now){
+
+    int best = -1;
+    double bestCompletion = 0;
+    float bestCycle = 0;
+
+    for(int a = 0; a < state.size(); a++){
+        if(state[a].offline || !reaches(a, blockPos)) continue;
+        float cycle = cycleTime(a, blockPos, targetPos);
+        double completion = completionTime(a, now) + cycle;
+        if(best < 0 || completion < bestCompletion){
+            best = a;
+            bestCompletion = completion;
+            bestCycle = cycle;
+        }
+    }
+
+    if(best >= 0)
+        state[best].queue.push_back({blockId, bestCycle});
+
+    return best;
+}
+
+/**
+ * @brief Pop the next block assigned to an arm
+ *
+ * @param arm
+ * @return int block id, -1 if the queue is empty
+ */
+int ArmDispatcher::next(int arm){
+    if(state[arm].queue.empty()) return -1;
+    int id = state[arm].queue.front().blockId;
+    state[arm].queue.pop_front();
+    return id;
+}
+
+/**
+ * @brief Remove from the queues of the arms the blocks assigned and not ordered yet, the orders being executed are kept
+ *
+ */
+void ArmDispatcher::clearQueues(){
+    for(int a = 0; a < state.size(); a++)
+        state[a].queue.clear();
+}
+
+/**
+ * @brief Record an order sent to an arm
+ *
+ * @param arm
+ * @param blockId
+ * @param cycle estimated time of the order [s]
+ * @param now [s]
+ */
+void ArmDispatcher::started(int arm, int blockId, float cycle, double now){
+    state[arm].blockInTransit = blockId;
+    state[arm].busyUntil = now + cycle;
+}
+
+/**
+ * @brief Record the end of the order of a block, the arm becomes idle
+ *
+ * @param blockId
+ * @param now [s]
+ * @return int index of the arm, -1 if no arm is moving the block
+ */
+int ArmDispatcher::completed(int blockId, double now){
+    int arm = armOf(blockId);
+    if(arm < 0) return -1;
+    state[arm].blockInTransit = -1;
+    state[arm].busyUntil = now;
+    state[arm].completed++;
+    return arm;
+}
+
+/**
+ * @brief Take back the order being executed by an arm, the arm becomes idle without counting the order as completed
+ *
+ * @param arm
+ * @param now [s]
+ * @return int block of the order, -1 if the arm is idle
+ */
+int ArmDispatcher::withdraw(int arm, double now){
+    int blockId = state[arm].blockInTransit;
+    state[arm].blockInTransit = -1;
+    state[arm].busyUntil = now;
+    return blockId;
+}
+
+/**
+ * @brief Stop or resume assigning blocks to an arm, the blocks already assigned to an arm going offline are dropped from
+ * its queue, they are assigned again from the work queue
+ *
+ * @param arm
+ * @param offline
+ */
+void ArmDispatcher::setOffline(int arm, bool offline){
+    state[arm].offline = offline;
+    if(offline) state[arm].queue.clear();
+}
+
+/**
+ * @brief Arm moving a block
+ *
+ * @param blockId
+ * @return int index of the arm, -1 if no arm is moving the block
+ */
+int ArmDispatcher::armOf(int blockId) const{
+    for(int a = 0; a < state.size(); a++)
+        if(blockId >= 0 && state[a].blockInTransit == blockId) return a;
+    return -1;
+}
+
+/**
+ * @brief True if no arm is executing an order or has blocks assigned
+ *
+ * @return true
+ * @return false
+ */
+bool ArmDispatcher::idle() const{
+    for(int a = 0; a < state.size(); a++)
+        if(state[a].blockInTransit >= 0 || !state[a].queue.empty()) return false;
+    return true;
+}
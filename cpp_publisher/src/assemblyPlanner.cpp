@@ -0,0 +1,287 @@
+/**
+ * @file assemblyPlanner.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the planner that assembles a structure with the detected blocks
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * A structure is a list of elements, each one a block of a given class in a given position. An element can be placed
+ * only after the elements below it (its supports) are placed, the supports form a dependency DAG computed from the geometry.
+ * Needs pickOrder.cpp and targetAllocator.cpp to be included before this file.
+ *
+ * Structure file format, one element per line, lines starting with # are comments:
+ *   blockClass x y z yaw
+ * with x, y the center of the block and z the height of its bottom, relative to the structure origin [m], yaw 0 or pi/2 [rad]
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <Eigen/Dense>
+#include <vector>
+#include <map>
+#include <cmath>
+
+using namespace std;
+using Eigen::Vector3f;
+
+///Tolerance used to decide if a block rests on another one [m]
+#define SUPPORT_TOLERANCE 0.005
+
+///States of an element of the structure
+enum ElementState { ELEMENT_TODO, ELEMENT_IN_PROGRESS, ELEMENT_PLACED };
+
+/**
+ * @brief Struct to store an element of the structure
+ *
+ */
+struct StructureElement{
+    int blockClass;
+    Vector3f position; // world frame position of the bottom center of the block
+    float yaw;
+    vector<int> supports; // elements this one rests on
+    vector<int> supported; // elements resting on this one
+    int missingSupports; // supports not placed yet
+    ElementState state;
+};
+
+/**
+ * @brief Planner assembling a structure, it chooses the next placement among the ones whose supports are already placed
+ *
+ */
+class AssemblyPlanner{
+public:
+    bool load(string path, Vector3f origin); // Load the structure from a file
+    bool active() const; // True if a structure is loaded
+    bool complete() const; // True if every element is placed
+    bool isNeeded(int blockClass) const; // True if an element of the class still has to be placed
+    int elementsToDo(int blockClass) const; // Number of elements of the class still to be placed
+    int selectPlacement(const vector<Vector3f>& blockPos, const vector<int>& blockClass, Vector3f startPos, int& element) const; // Choose the next block and element
+    Vector3f targetOf(int element) const; // Target position to send to the move node
+    float yawOf(int element) const; // Yaw of the block at the release to send to the move node
+    void startPlacement(int element, int blockId); // Mark an element as in progress
+    void completePlacement(int blockId, bool success); // Mark the element of a block as placed, or to do again
+
+private:
+    vector<StructureElement> elements;
+    map<int, int> elementOfBlock; // block id -> element in progress
+
+    void buildDependencies();
+    bool overlap(const StructureElement& a, const StructureElement& b) const;
+};
+
+/**
+ * @brief Load the structure from a file, placing its origin in a given world frame position
+ *
+ * @param path
+ * @param origin world frame position of the structure origin on the table
+ * @return true if the file is read and contains at least one element
+ */
+bool AssemblyPlanner::load(string path, Vector3f origin){
+
+    ifstream file(path);
+    if(!file.is_open()){
+        cout << "Cannot open structure file " << path << endl;
+        return false;
+    }
+
+    elements.clear();
+    elementOfBlock.clear();
+
+    string line;
+    while(getline(file, line)){
+        if(line.empty() || line[0] == '#') continue;
+
+        istringstream stream(line);
+        StructureElement element;
+        float x, y, z;
+        if(!(stream >> element.blockClass >> x >> y >> z >> element.yaw)) continue;
+
+        element.position = origin + Vector3f(x, y, z);
+        element.state = ELEMENT_TODO;
+        elements.push_back(element);
+    }
+
+    buildDependencies();
+
+    cout << "Loaded structure with " << elements.size() << " blocks" << endl;
+    return !elements.empty();
+}
+
+/**
+ * @brief Check if the footprints of two elements overlap
+ *
+ * @param a
+ * @param b
+ * @return true
+ * @return false
+ */
+bool AssemblyPlanner::overlap(const StructureElement& a, const StructureElement& b) const{
+
+    Eigen::Vector2f halfA(BLOCK_FOOTPRINT[a.blockClass][0] / 2, BLOCK_FOOTPRINT[a.blockClass][1] / 2);
+    Eigen::Vector2f halfB(BLOCK_FOOTPRINT[b.blockClass][0] / 2, BLOCK_FOOTPRINT[b.blockClass][1] / 2);
+    if(fabs(sin(a.yaw)) > 0.5) halfA.reverseInPlace();
+    if(fabs(sin(b.yaw)) > 0.5) halfB.reverseInPlace();
+
+    return fabs(a.position(0) - b.position(0)) < halfA(0) + halfB(0) - SUPPORT_TOLERANCE &&
+           fabs(a.position(1) - b.position(1)) < halfA(1) + halfB(1) - SUPPORT_TOLERANCE;
+}
+
+/**
+ * @brief Build the support DAG: an element rests on every lower element whose top reaches its bottom and whose footprint overlaps its own
+ *
+ */
+void AssemblyPlanner::buildDependencies(){
+
+    for(int a = 0; a < elements.size(); a++){
+        for(int b = 0; b < elements.size(); b++){
+            float gap = elements[a].position(2) - elements[b].position(2);
+            if(gap > SUPPORT_TOLERANCE && gap <= BLOCK_HEIGHT[elements[b].blockClass] + SUPPORT_TOLERANCE && overlap(elements[a], elements[b])){
+                elements[a].supports.push_back(b);
+                elements[b].supported.push_back(a);
+            }
+        }
+        elements[a].missingSupports = elements[a].supports.size();
+    }
+}
+
+/**
+ * @brief True if a structure is loaded
+ *
+ * @return true
+ * @return false
+ */
+bool AssemblyPlanner::active() const{
+    return !elements.empty();
+}
+
+/**
+ * @brief True if every element of the structure is placed
+ *
+ * @return true
+ * @return false
+ */
+bool AssemblyPlanner::complete() const{
+    for(int i = 0; i < elements.size(); i++)
+        if(elements[i].state != ELEMENT_PLACED) return false;
+    return true;
+}
+
+/**
+ * @brief True if an element of the given class still has to be placed
+ *
+ * @param blockClass
+ * @return true
+ * @return false
+ */
+bool AssemblyPlanner::isNeeded(int blockClass) const{
+    for(int i = 0; i < elements.size(); i++)
+        if(elements[i].blockClass == blockClass && elements[i].state == ELEMENT_TODO) return true;
+    return false;
+}
+
+/**
+ * @brief Number of elements of the given class still to be placed, ready or waiting for their supports
+ *
+ * @param blockClass
+ * @return int
+ */
+int AssemblyPlanner::elementsToDo(int blockClass) const{
+    int count = 0;
+    for(int i = 0; i < elements.size(); i++)
+        if(elements[i].blockClass == blockClass && elements[i].state == ELEMENT_TODO) count++;
+    return count;
+}
+
+/**
+ * @brief Choose the next placement among the ready ones, the elements whose supports are all placed.
+ * Every ready element is paired with every available block of its class and the pair with the lowest estimated cycle time is chosen
+ *
+ * @param blockPos world frame position of the available blocks
+ * @param blockClass class of the available blocks
+ * @param startPos base frame position of the end effector before the pick
+ * @param element chosen element
+ * @return int index of the chosen block, -1 if no ready element has a block available
+ */
+int AssemblyPlanner::selectPlacement(const vector<Vector3f>& blockPos, const vector<int>& blockClass, Vector3f startPos, int& element) const{
+
+    int bestBlock = -1;
+    float bestTime = 0;
+
+    for(int e = 0; e < elements.size(); e++){
+        if(elements[e].state != ELEMENT_TODO || elements[e].missingSupports > 0) continue;
+
+        for(int b = 0; b < blockPos.size(); b++){
+            if(blockClass[b] != elements[e].blockClass) continue;
+
+            float time = estimatePickCycle(startPos, blockPos[b], targetOf(e)).time;
+            if(bestBlock < 0 || time < bestTime){
+                bestBlock = b;
+                bestTime = time;
+                element = e;
+            }
+        }
+    }
+
+    return bestBlock;
+}
+
+/**
+ * @brief Target position of an element to send to the move node, at the placement height of the target area raised by the element height
+ *
+ * @param element
+ * @return Vector3f
+ */
+Vector3f AssemblyPlanner::targetOf(int element) const{
+    Vector3f target = elements[element].position;
+    target(2) += TARGET_AREA_Z;
+    return target;
+}
+
+/**
+ * @brief Yaw of the block of an element at the release, to send to the move node
+ *
+ * @param element
+ * @return float 0 or pi/2 [rad]
+ */
+float AssemblyPlanner::yawOf(int element) const{
+    return elements[element].yaw;
+}
+
+/**
+ * @brief Mark an element as in progress, moved by the block with the given id
+ *
+ * @param element
+ * @param blockId
+ */
+void AssemblyPlanner::startPlacement(int element, int blockId){
+    elements[element].state = ELEMENT_IN_PROGRESS;
+    elementOfBlock[blockId] = element;
+}
+
+/**
+ * @brief Mark the element moved by a block as placed, releasing the elements resting on it, or as to do again if the movement failed
+ *
+ * @param blockId
+ * @param success
+ */
+void AssemblyPlanner::completePlacement(int blockId, bool success){
+
+    auto it = elementOfBlock.find(blockId);
+    if(it == elementOfBlock.end()) return;
+
+    StructureElement& element = elements[it->second];
+    elementOfBlock.erase(it);
+
+    if(!success){
+        element.state = ELEMENT_TODO;
+        return;
+    }
+
+    element.state = ELEMENT_PLACED;
+    for(int i = 0; i < element.supported.size(); i++)
+        elements[element.supported[i]].missingSupports--;
+}
@@ -0,0 +1,471 @@
+/**
+ * @file blockDetector.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the node detecting the blocks on the CPU, a drop in replacement of the vision node
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The model is loaded once at startup and kept with its buffers for the whole session, instead of being read from disk
+ * on every detection request. The callbacks only keep the last messages: on a detection request the next image is given
+ * to the detection thread, which crops it, runs the network, looks up the pixels of the blocks in the point cloud with
+ * the nearest stamp and publishes the blocks on the table on the topics of the vision node.
+ * When the table is found in the point cloud, the detector runs only on the regions of the blocks segmented above it,
+ * packed in a single input of the network, otherwise on the whole part of the image over the table.
+ * If the directory of the STL models is given, the pose of every block detected on a segmented cluster is estimated by
+ * registration of the points of the cluster on the model of its class, and published with the block.
+ * The yaw of every block detected on a cluster, from the principal axes of its points, is published with the block for
+ * the gripper to grasp it along its short side.
+ * The time spent in each stage is printed for every detection, with its mean and 90th percentile over the last ones.
+ *
+ * The model is exported from the weights of the vision node with: yolo export model=bestm.pt format=onnx imgsz=640
+ */
+
+#include <iostream>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+#include <ros/ros.h>
+#include <std_msgs/Bool.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <cpp_publisher/BlockInfo.h> // Nearest block, for the tools still using the original message
+#include <cpp_publisher/BlockInfoArray.h> // Every block on the table
+
+#include "pointCloudLookup.cpp" // Direct lookup of the points of an organized point cloud
+#include "tableSegmentation.cpp" // Plane of the table and clusters of the blocks above it
+#include "poseEstimation.cpp" // Pose of the blocks by ICP on the STL models
+#include "yoloDetector.cpp" // YOLO on the CPU with OpenCV DNN
+
+///Set to 1 to detect on every image, without waiting for the detection requests of the planner
+#define DEBUG 0
+///Number of point clouds kept, the one nearest to the image is used
+#define CLOUD_HISTORY 4
+///Number of detections in the latency statistics
+#define LATENCY_WINDOW 100
+
+//Limits of the blocks on the table, the height depends on the camera [m]
+#define MIN_X 0.05
+#define MAX_X 0.5
+#define MIN_Y 0.2
+#define MAX_Y 0.8
+
+//Stages of a detection, in order
+enum DetectorStage { STAGE_CONVERT, STAGE_SEGMENT, STAGE_PREPROCESS, STAGE_INFERENCE, STAGE_POSTPROCESS, STAGE_POSE, STAGE_LOOKUP, STAGE_PUBLISH, STAGE_TOTAL, DETECTOR_STAGES };
+///Name of each stage
+const char* DETECTOR_STAGE_NAMES[DETECTOR_STAGES] = {"convert", "segment", "preprocess", "inference", "postprocess", "pose", "lookup", "publish", "total"};
+
+ros::Publisher blockPublisher, blocksPublisher;
+
+///Last point clouds received, the newest at the back
+deque<sensor_msgs::PointCloud2::ConstPtr> clouds;
+///Image waiting for the detection thread, null if none
+sensor_msgs::Image::ConstPtr pendingImage;
+///True from a detection request to the next image
+bool detectionRequested = DEBUG;
+///Lock of the messages shared with the detection thread
+mutex messageLock;
+condition_variable imageReady;
+
+///True to run the detector only on the regions of the blocks segmented in the point cloud
+bool useRois = true;
+///Random generator of the fit of the table
+mt19937 segmentationRandom(1);
+///Models of the blocks, used if the models parameter is set
+PoseEstimator poseEstimator;
+bool estimatePoses = false;
+
+///Latency of the last detections for each stage [s]
+deque<double> latencies[DETECTOR_STAGES];
+
+///Trace ids of the detections: random prefix of the session and counter of the detections, as in the vision node
+uint64_t traceSession = 0;
+uint64_t traceCounter = 0;
+
+void imageCallback(const sensor_msgs::Image::ConstPtr& image); // Give an image to the detection thread if requested
+void cloudCallback(const sensor_msgs::PointCloud2::ConstPtr& cloud); // Keep a point cloud
+void detectionRequestCallback(const std_msgs::Bool::ConstPtr& request); // Wait for the next image
+void detectionLoop(YoloDetector& detector); // Detect the blocks of every image given by the callbacks
+bool imageToMat(const sensor_msgs::Image& image, cv::Mat& mat); // Wrap the data of an image
+sensor_msgs::PointCloud2::ConstPtr nearestCloud(ros::Time stamp); // Point cloud kept with the nearest stamp
+vector<cv::Rect> blockRegions(const TableSegmentation& segmentation, const cv::Mat& frame); // Regions of the blocks above the table
+vector<int> detectionClusters(const vector<Detection>& detections, const TableSegmentation& segmentation); // Cluster of every detection
+vector<BlockPose> blockPoses(const vector<Detection>& detections, const vector<int>& clusters, const TableSegmentation& segmentation); // Pose of the blocks detected on a cluster
+double publishBlocks(const vector<Detection>& detections, const vector<BlockPose>& poses, const vector<float>& yaws, const sensor_msgs::Image& image, const sensor_msgs::PointCloud2::ConstPtr& cloud); // Look up and publish the blocks on the table
+void recordLatency(const double times[DETECTOR_STAGES]); // Print the latency of a detection and the statistics
+
+int main(int argc, char **argv){
+
+    ros::init(argc, argv, "block_detector");
+    ros::NodeHandle node;
+    ros::NodeHandle privateNode("~");
+
+    string model;
+    int inputSize, threads;
+    privateNode.param<string>("model", model, "");
+    privateNode.param<int>("input_size", inputSize, YOLO_INPUT_SIZE);
+    privateNode.param<int>("threads", threads, 0);
+    privateNode.param<bool>("rois", useRois, true);
+    string models;
+    privateNode.param<string>("models", models, "");
+
+    if(model.empty()){
+        cout << "Set the model parameter to the path of the ONNX model" << endl;
+        return 1;
+    }
+    if(!loadCameraConfig(node))
+        return 1;
+
+    YoloDetector detector(model, inputSize, threads);
+    if(!detector.loaded())
+        return 1;
+
+    if(!models.empty()){
+        int loaded = poseEstimator.loadModels(models);
+        cout << "Loaded " << loaded << "/" << MODEL_CLASSES << " block models from " << models << endl;
+        estimatePoses = loaded > 0;
+    }
+
+    random_device seed;
+    traceSession = (uint64_t)seed() << 32;
+
+    blockPublisher = node.advertise<cpp_publisher::BlockInfo>("vision/vision_detection", 10);
+    blocksPublisher = node.advertise<cpp_publisher::BlockInfoArray>("vision/vision_detections", 10);
+
+    ros::Subscriber imageSubscriber = node.subscribe("/ur5/zed_node/left/image_rect_color", 1, imageCallback, ros::TransportHints().tcpNoDelay());
+    ros::Subscriber cloudSubscriber = node.subscribe("/ur5/zed_node/point_cloud/cloud_registered", 1, cloudCallback, ros::TransportHints().tcpNoDelay());
+    ros::Subscriber requestSubscriber = node.subscribe("/planner/detection_request", 10, detectionRequestCallback);
+
+    //The callbacks only keep the messages, the detection runs on its own thread
+    thread detection(detectionLoop, ref(detector));
+
+    cout << "Waiting for detection request" << endl;
+    ros::spin();
+
+    imageReady.notify_all();
+    detection.join();
+    return 0;
+}
+
+/**
+ * @brief Give an image to the detection thread if a detection was requested
+ *
+ * @param image
+ */
+void imageCallback(const sensor_msgs::Image::ConstPtr& image){
+    lock_guard<mutex> guard(messageLock);
+    if(!detectionRequested) return;
+    detectionRequested = DEBUG;
+    pendingImage = image;
+    imageReady.notify_one();
+}
+
+/**
+ * @brief Keep a point cloud, dropping the oldest one
+ *
+ * @param cloud
+ */
+void cloudCallback(const sensor_msgs::PointCloud2::ConstPtr& cloud){
+    lock_guard<mutex> guard(messageLock);
+    clouds.push_back(cloud);
+    if(clouds.size() > CLOUD_HISTORY)
+        clouds.pop_front();
+}
+
+/**
+ * @brief Detect the blocks of the next image
+ *
+ * @param request
+ */
+void detectionRequestCallback(const std_msgs::Bool::ConstPtr& request){
+    cout << "Detection request received" << endl;
+    lock_guard<mutex> guard(messageLock);
+    detectionRequested = true;
+}
+
+/**
+ * @brief Detect the blocks of every image given by the image callback, until the node is shut down
+ *
+ * @param detector
+ */
+void detectionLoop(YoloDetector& detector){
+
+    while(ros::ok()){
+        sensor_msgs::Image::ConstPtr image;
+        {
+            unique_lock<mutex> lock(messageLock);
+            imageReady.wait_for(lock, chrono::milliseconds(100), []{ return (bool)pendingImage; });
+            if(!pendingImage) continue;
+            image = pendingImage;
+            pendingImage.reset();
+        }
+
+        double times[DETECTOR_STAGES];
+        auto start = chrono::steady_clock::now();
+
+        cv::Mat frame;
+        if(!imageToMat(*image, frame) || frame.cols <= camera.cropWidth || frame.rows <= camera.cropHeight){
+            cout << "Unsupported image " << image->encoding << " " << image->width << "x" << image->height << endl;
+            continue;
+        }
+        sensor_msgs::PointCloud2::ConstPtr cloud = nearestCloud(image->header.stamp);
+        times[STAGE_CONVERT] = secondsSince(start);
+
+        //The workspace holds the table around the blocks
+        auto segmentStart = chrono::steady_clock::now();
+        TableSegmentation segmentation;
+        segmentation.planeFound = false;
+        if(cloud && cloud->width == image->width && cloud->height == image->height)
+            segmentation = segmentTable(*cloud, Vector3f(MIN_X, MIN_Y, camera.minZ - 0.1), Vector3f(MAX_X, MAX_Y, camera.maxZ + 0.1), segmentationRandom);
+        vector<cv::Rect> regions = blockRegions(segmentation, frame);
+        times[STAGE_SEGMENT] = secondsSince(segmentStart);
+
+        DetectionTiming timing;
+        vector<Detection> detections;
+        if(useRois && !regions.empty()){
+            detections = detector.detectPatches(frame, regions, timing);
+        }else{
+            //The network works on the part of the image over the table, without copying it
+            cv::Mat cropped = frame(cv::Rect(camera.cropWidth, camera.cropHeight, frame.cols - camera.cropWidth, frame.rows - camera.cropHeight));
+            detections = detector.detect(cropped, timing);
+            for(int i = 0; i < detections.size(); i++){
+                detections[i].x += camera.cropWidth;
+                detections[i].y += camera.cropHeight;
+                detections[i].box.x += camera.cropWidth;
+                detections[i].box.y += camera.cropHeight;
+            }
+        }
+        times[STAGE_PREPROCESS] = timing.preprocess;
+        times[STAGE_INFERENCE] = timing.inference;
+        times[STAGE_POSTPROCESS] = timing.postprocess;
+
+        auto poseStart = chrono::steady_clock::now();
+        vector<int> clusters = detectionClusters(detections, segmentation);
+        vector<BlockPose> poses = blockPoses(detections, clusters, segmentation);
+        vector<float> yaws(detections.size(), 0);
+        for(int i = 0; i < detections.size(); i++)
+            if(clusters[i] >= 0) yaws[i] = segmentation.clusters[clusters[i]].yaw;
+        times[STAGE_POSE] = secondsSince(poseStart);
+
+        auto lookupStart = chrono::steady_clock::now();
+        times[STAGE_LOOKUP] = publishBlocks(detections, poses, yaws, *image, cloud);
+        times[STAGE_PUBLISH] = secondsSince(lookupStart) - times[STAGE_LOOKUP];
+        times[STAGE_TOTAL] = secondsSince(start);
+
+        recordLatency(times);
+    }
+}
+
+/**
+ * @brief Wrap the data of an image in a matrix, without copying it
+ *
+ * @param image bgr8 or bgra8 image
+ * @param mat
+ * @return true if the encoding is supported
+ */
+bool imageToMat(const sensor_msgs::Image& image, cv::Mat& mat){
+
+    int type;
+    if(image.encoding == "bgr8") type = CV_8UC3;
+    else if(image.encoding == "bgra8") type = CV_8UC4;
+    else return false;
+
+    if(image.data.size() < (size_t)image.step * image.height) return false;
+
+    mat = cv::Mat(image.height, image.width, type, const_cast<uint8_t*>(image.data.data()), image.step);
+    return true;
+}
+
+/**
+ * @brief Point cloud kept with the stamp nearest to the one given
+ *
+ * @param stamp
+ * @return sensor_msgs::PointCloud2::ConstPtr null if no point cloud was received
+ */
+sensor_msgs::PointCloud2::ConstPtr nearestCloud(ros::Time stamp){
+    lock_guard<mutex> guard(messageLock);
+    sensor_msgs::PointCloud2::ConstPtr cloud;
+    for(int i = 0; i < clouds.size(); i++)
+        if(!cloud || fabs((clouds[i]->header.stamp - stamp).toSec()) < fabs((cloud->header.stamp - stamp).toSec()))
+            cloud = clouds[i];
+    return cloud;
+}
+
+/**
+ * @brief Regions of the image covered by the blocks segmented above the table
+ *
+ * @param segmentation segmentation of a point cloud with the resolution of the image
+ * @param frame image
+ * @return vector<cv::Rect> empty if the table was not found
+ */
+vector<cv::Rect> blockRegions(const TableSegmentation& segmentation, const cv::Mat& frame){
+
+    vector<cv::Rect> regions;
+    for(int i = 0; i < segmentation.clusters.size(); i++){
+        const BlockCluster& cluster = segmentation.clusters[i];
+        regions.push_back(cv::Rect(cluster.u0, cluster.v0, cluster.u1 - cluster.u0, cluster.v1 - cluster.v0) & cv::Rect(0, 0, frame.cols, frame.rows));
+    }
+    return regions;
+}
+
+/**
+ * @brief Find the cluster of every detection: the smallest one whose region holds the centre of the detection
+ *
+ * @param detections detections with the pixels of the whole image
+ * @param segmentation
+ * @return vector<int> index of the cluster of each detection, -1 if none
+ */
+vector<int> detectionClusters(const vector<Detection>& detections, const TableSegmentation& segmentation){
+
+    vector<int> clusters(detections.size(), -1);
+    if(!segmentation.planeFound) return clusters;
+
+    for(int i = 0; i < detections.size(); i++){
+        int bestArea = 0;
+        for(int c = 0; c < segmentation.clusters.size(); c++){
+            const BlockCluster& cluster = segmentation.clusters[c];
+            if(detections[i].x < cluster.u0 || detections[i].x >= cluster.u1 || detections[i].y < cluster.v0 || detections[i].y >= cluster.v1) continue;
+            int area = (cluster.u1 - cluster.u0) * (cluster.v1 - cluster.v0);
+            if(clusters[i] < 0 || area < bestArea){
+                clusters[i] = c;
+                bestArea = area;
+            }
+        }
+    }
+    return clusters;
+}
+
+/**
+ * @brief Estimate the pose of every block detected inside the region of a cluster, from the points of its cluster
+ *
+ * @param detections detections with the pixels of the whole image
+ * @param clusters index of the cluster of each detection, -1 if none
+ * @param segmentation
+ * @return vector<BlockPose> pose of each detection, not valid if not estimated
+ */
+vector<BlockPose> blockPoses(const vector<Detection>& detections, const vector<int>& clusters, const TableSegmentation& segmentation){
+
+    vector<BlockPose> poses(detections.size());
+    for(int i = 0; i < detections.size(); i++){
+        poses[i].valid = false;
+        if(estimatePoses && clusters[i] >= 0)
+            poses[i] = poseEstimator.estimate(detections[i].blockClass, segmentation.clusters[clusters[i]].points, segmentation.normal, segmentation.offset);
+    }
+    return poses;
+}
+
+/**
+ * @brief Look up the detections in the point cloud and publish the blocks on the table,
+ * all of them with their confidence and the nearest to the camera alone, as the vision node does
+ *
+ * @param detections detections with the pixels of the whole image
+ * @param poses pose of each detection
+ * @param yaws yaw of each detection in the world frame, 0 if not estimated
+ * @param image
+ * @param cloud point cloud nearest to the image, null if none
+ * @return double time spent in the lookup [s]
+ */
+double publishBlocks(const vector<Detection>& detections, const vector<BlockPose>& poses, const vector<float>& yaws, const sensor_msgs::Image& image, const sensor_msgs::PointCloud2::ConstPtr& cloud){
+
+    auto start = chrono::steady_clock::now();
+
+    vector<int> u, v;
+    for(int i = 0; i < detections.size(); i++){
+        u.push_back(detections[i].x);
+        v.push_back(detections[i].y);
+    }
+
+    vector<Vector3f> points;
+    vector<bool> valid(detections.size(), false);
+    if(cloud)
+        lookupPixels(*cloud, u, v, points, valid);
+    else
+        cout << "No point cloud received yet" << endl;
+
+    double lookupTime = secondsSince(start);
+
+    cpp_publisher::BlockInfoArray msg;
+    msg.header.stamp = cloud ? cloud->header.stamp : image.header.stamp;
+    msg.header.frame_id = image.header.frame_id;
+
+    for(int i = 0; i < detections.size(); i++){
+        if(!valid[i]) continue;
+        const Vector3f& p = points[i];
+        if(p(2) < camera.minZ || p(2) > camera.maxZ || p(0) < MIN_X || p(0) > MAX_X || p(1) <= MIN_Y || p(1) >= MAX_Y) continue;
+
+        cpp_publisher::BlockInfoV2 block;
+        block.header = msg.header;
+        block.blockId = msg.blocks.size();
+        block.traceId = traceSession | ++traceCounter;
+        block.blockClass = detections[i].blockClass;
+        //The planner receives the position without the calibration of x, as from the vision node
+        block.blockPosition.x = p(0) + 0.02;
+        block.blockPosition.y = p(1);
+        block.blockPosition.z = p(2);
+        block.confidence = detections[i].confidence;
+        if(poses[i].valid){
+            Eigen::Quaternionf orientation(poses[i].rotation);
+            block.blockOrientation.x = orientation.x();
+            block.blockOrientation.y = orientation.y();
+            block.blockOrientation.z = orientation.z();
+            block.blockOrientation.w = orientation.w();
+        }
+        block.blockYaw = yaws[i];
+        msg.blocks.push_back(block);
+    }
+
+    //Nearest block to the camera, zero if none
+    cpp_publisher::BlockInfo nearest;
+    nearest.blockId.data = 0;
+    nearest.blockClass.data = 0;
+    for(int i = 0; i < msg.blocks.size(); i++){
+        if(i == 0 || msg.blocks[i].blockPosition.x < nearest.blockPosition.x){
+            nearest.blockId.data = msg.blocks[i].blockId;
+            nearest.blockClass.data = msg.blocks[i].blockClass;
+            nearest.blockPosition = msg.blocks[i].blockPosition;
+        }
+    }
+    if(msg.blocks.empty())
+        cout << "No blocks detected" << endl;
+
+    cout << "Publishing " << msg.blocks.size() << " blocks of " << detections.size() << " detections" << endl;
+    blocksPublisher.publish(msg);
+    blockPublisher.publish(nearest);
+
+    return lookupTime;
+}
+
+/**
+ * @brief Print the latency of each stage of a detection, with the mean and the 90th percentile over the last detections
+ *
+ * @param times time of each stage [s]
+ */
+void recordLatency(const double times[DETECTOR_STAGES]){
+
+    ostringstream report; // Local stream, to leave the format of cout untouched
+    report << fixed << setprecision(2);
+    for(int s = 0; s < DETECTOR_STAGES; s++){
+        deque<double>& window = latencies[s];
+        window.push_back(times[s]);
+        if(window.size() > LATENCY_WINDOW)
+            window.pop_front();
+
+        vector<double> sorted(window.begin(), window.end());
+        int rank = min((int)sorted.size() - 1, max(0, (int)ceil(0.9 * sorted.size()) - 1));
+        nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        double mean = accumulate(window.begin(), window.end(), 0.0) / window.size();
+
+        report << "  " << DETECTOR_STAGE_NAMES[s] << ": " << times[s] * 1000 << " ms (mean " << mean * 1000
+               << " ms, p90 " << sorted[rank] * 1000 << " ms over " << window.size() << ")" << endl;
+    }
+    cout << report.str() << flush;
+}
@@ -0,0 +1,219 @@
+/**
+ * @file blockRegistry.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the registry of the blocks known by the planner, its model of the world
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The blocks are indexed by a spatial hash on the table plane with cells as large as the association radius,
+ * so a detection is associated to the known blocks looking only at the 3x3 cells around it.
+ * Needs poseFilter.cpp to be included before this file.
+ */
+
+#include <iostream>
+#include <Eigen/Dense>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cmath>
+
+using namespace std;
+using Eigen::Vector3f;
+
+///Maximum distance on the table plane between a detection and a known block to be considered the same block [m]
+#define ASSOCIATION_RADIUS 0.025
+
+///States of a known block
+enum BlockState { BLOCK_ON_TABLE, BLOCK_IN_TRANSIT, BLOCK_PLACED };
+
+/**
+ * @brief Struct to store a block known by the planner
+ *
+ */
+struct KnownBlock{
+    int id;
+    int blockClass;
+    Vector3f position; // world frame position
+    PositionFilter filter; // estimate fusing the detections of the block while it is on the table
+    float yaw; // rotation of the long side of the block about the world z axis from the y axis, of its most confident detection
+    bool flippedGrasp; // the gripper grasps the block turned by pi from its yaw, chosen by the last plan
+    float confidence; // highest confidence among the detections of the block
+    BlockState state;
+    int detections; // number of detections associated to the block
+    double lastSeen; // time of the last detection [s]
+    uint64_t traceId; // trace of the first detection, followed by the move order and the acks, 0 if not traced
+};
+
+/**
+ * @brief Registry of the known blocks, it associates the detections to the blocks and tracks their state
+ *
+ */
+class BlockRegistry{
+public:
+    int associate(Vector3f position, int blockClass, float yaw, float confidence, double stamp, bool& isNew); // Associate a detection to a known block or register a new one
+    KnownBlock& get(int id); // Block with the given id
+    void setState(int id, BlockState state); // Change the state of a block
+    void moveTo(int id, Vector3f position); // Change the position of a block, keeping the index updated
+    int size() const; // Number of known blocks
+
+private:
+    vector<KnownBlock> blocks; // indexed by id
+    unordered_map<long long, vector<int>> cells; // spatial hash: cell -> ids of the blocks in it
+
+    long long cellKey(int cellX, int cellY) const;
+    void insertInCell(int id);
+    void removeFromCell(int id);
+};
+
+/**
+ * @brief Key of a cell of the spatial hash
+ *
+ * @param cellX
+ * @param cellY
+ * @return long long
+ */
+long long BlockRegistry::cellKey(int cellX, int cellY) const{
+    return ((long long)cellX << 32) ^ (unsigned int)cellY;
+}
+
+/**
+ * @brief Add a block to the cell containing its position
+ *
+ * @param id
+ */
+void BlockRegistry::insertInCell(int id){
+    int cellX = floor(blocks[id].position(0) / ASSOCIATION_RADIUS);
+    int cellY = floor(blocks[id].position(1) / ASSOCIATION_RADIUS);
+    cells[cellKey(cellX, cellY)].push_back(id);
+}
+
+/**
+ * @brief Remove a block from the cell containing its position
+ *
+ * @param id
+ */
+void BlockRegistry::removeFromCell(int id){
+    int cellX = floor(blocks[id].position(0) / ASSOCIATION_RADIUS);
+    int cellY = floor(blocks[id].position(1) / ASSOCIATION_RADIUS);
+    vector<int>& cell = cells[cellKey(cellX, cellY)];
+    for(int i = 0; i < cell.size(); i++){
+        if(cell[i] == id){
+            cell.erase(cell.begin() + i);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Associate a detection to the nearest known block within the association radius, or register it as a new block.
+ * The detections of a block on the table are fused in its position estimate, the blocks in transit or placed are not changed
+ *
+ * @param position world frame position of the detection
+ * @param blockClass
+ * @param yaw yaw of the detection in the world frame, 0 if not estimated
+ * @param confidence
+ * @param stamp time of the detection [s]
+ * @param isNew set to true if the detection is a new block
+ * @return int id of the block
+ */
+int BlockRegistry::associate(Vector3f position, int blockClass, float yaw, float confidence, double stamp, bool& isNew){
+
+    int cellX = floor(position(0) / ASSOCIATION_RADIUS);
+    int cellY = floor(position(1) / ASSOCIATION_RADIUS);
+
+    int nearest = -1;
+    float nearestDistance = ASSOCIATION_RADIUS;
+
+    for(int dx = -1; dx <= 1; dx++){
+        for(int dy = -1; dy <= 1; dy++){
+            auto cell = cells.find(cellKey(cellX + dx, cellY + dy));
+            if(cell == cells.end()) continue;
+            for(int i = 0; i < cell->second.size(); i++){
+                int id = cell->second[i];
+                float distance = (blocks[id].position - position).head<2>().norm();
+                if(distance < nearestDistance){
+                    nearest = id;
+                    nearestDistance = distance;
+                }
+            }
+        }
+    }
+
+    if(nearest >= 0){
+        isNew = false;
+        KnownBlock& block = blocks[nearest];
+        block.detections++;
+        block.lastSeen = stamp;
+        if(block.state == BLOCK_ON_TABLE){
+            fuseDetection(block.filter, position, detectionNoise(confidence));
+            moveTo(nearest, block.filter.mean);
+            if(confidence >= block.confidence){
+                block.blockClass = blockClass;
+                block.yaw = yaw;
+            }
+        }
+        block.confidence = max(block.confidence, confidence);
+        return nearest;
+    }
+
+    isNew = true;
+    KnownBlock block;
+    block.id = blocks.size();
+    block.blockClass = blockClass;
+    block.position = position;
+    initFilter(block.filter, position, detectionNoise(confidence));
+    block.yaw = yaw;
+    block.flippedGrasp = false;
+    block.confidence = confidence;
+    block.state = BLOCK_ON_TABLE;
+    block.detections = 1;
+    block.lastSeen = stamp;
+    block.traceId = 0;
+    blocks.push_back(block);
+    insertInCell(block.id);
+
+    return block.id;
+}
+
+/**
+ * @brief Block with the given id
+ *
+ * @param id
+ * @return KnownBlock&
+ */
+KnownBlock& BlockRegistry::get(int id){
+    return blocks[id];
+}
+
+/**
+ * @brief Change the state of a block
+ *
+ * @param id
+ * @param state
+ */
+void BlockRegistry::setState(int id, BlockState state){
+    blocks[id].state = state;
+}
+
+/**
+ * @brief Change the position of a block, keeping the spatial hash updated
+ *
+ * @param id
+ * @param position world frame position
+ */
+void BlockRegistry::moveTo(int id, Vector3f position){
+    removeFromCell(id);
+    blocks[id].position = position;
+    insertInCell(id);
+}
+
+/**
+ * @brief Number of known blocks
+ *
+ * @return int
+ */
+int BlockRegistry::size() const{
+    return blocks.size();
+}
@@ -0,0 +1,182 @@
+/**
+ * @file cellMetrics.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the throughput and latency metrics of the cell
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Every block carries the time it reached each stage, from the detection request to the ack of the move node.
+ * The blocks completed in a rolling window give the throughput and the percentiles of the time spent between stages.
+ */
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+///Stages reached by a block, in order
+enum BlockStage { STAGE_REQUESTED, STAGE_DETECTED, STAGE_ORDERED, STAGE_STARTED, STAGE_GRASPED, STAGE_PLACED, STAGE_ACKED, STAGE_COUNT };
+
+///Name of each stage
+const char* STAGE_NAMES[STAGE_COUNT] = {"request", "detection", "order", "move start", "grasp", "place", "ack"};
+
+/**
+ * @brief Struct to store the time each stage is reached by a block, 0 if not reached
+ *
+ */
+struct BlockTimeline{
+    double stamp[STAGE_COUNT];
+    bool success;
+};
+
+/**
+ * @brief Struct to store the metrics over the rolling window
+ *
+ */
+struct MetricsSummary{
+    float blocksPerMinute;
+    int blocksPlaced; // since the start
+    int blocksFailed; // since the start
+    vector<string> intervals; // name of each interval, between consecutive stages and end to end
+    vector<float> p50, p90, p99; // percentiles of each interval [s]
+};
+
+/**
+ * @brief Collector of the timelines of the blocks
+ *
+ */
+class CellMetrics{
+public:
+    CellMetrics(double window);
+
+    void mark(int blockId, BlockStage stage, double time); // Record the first time a block reaches a stage
+    void complete(int blockId, bool success, double time); // Record the ack of the move node for a block
+    MetricsSummary summary(double now); // Metrics over the window ending now
+
+private:
+    double window; // length of the rolling window [s]
+    double firstEvent; // time of the first recorded stage
+    int placed, failed;
+    map<int, BlockTimeline> active; // block id -> timeline of the blocks not placed yet
+    deque<BlockTimeline> completed; // timelines of the blocks placed, oldest first
+
+    static float percentile(vector<float>& values, float p);
+};
+
+/**
+ * @brief Construct an empty collector
+ *
+ * @param window length of the rolling window [s]
+ */
+CellMetrics::CellMetrics(double window){
+    this->window = window;
+    firstEvent = 0;
+    placed = 0;
+    failed = 0;
+}
+
+/**
+ * @brief Record the time a block reaches a stage, only the first time the stage is reached is kept
+ *
+ * @param blockId
+ * @param stage
+ * @param time [s]
+ */
+void CellMetrics::mark(int blockId, BlockStage stage, double time){
+
+    if(firstEvent == 0) firstEvent = time;
+
+    auto it = active.find(blockId);
+    if(it == active.end()){
+        BlockTimeline timeline;
+        fill(timeline.stamp, timeline.stamp + STAGE_COUNT, 0.0);
+        timeline.success = false;
+        it = active.insert(make_pair(blockId, timeline)).first;
+    }
+
+    if(it->second.stamp[stage] == 0) it->second.stamp[stage] = time;
+}
+
+/**
+ * @brief Record the ack of the move node for a block. A placed block is moved to the window,
+ * a failed one keeps its request and detection times and waits to be ordered again
+ *
+ * @param blockId
+ * @param success
+ * @param time [s]
+ */
+void CellMetrics::complete(int blockId, bool success, double time){
+
+    auto it = active.find(blockId);
+    if(it == active.end()) return;
+
+    if(!success){
+        failed++;
+        fill(it->second.stamp + STAGE_ORDERED, it->second.stamp + STAGE_COUNT, 0.0);
+        return;
+    }
+
+    it->second.stamp[STAGE_ACKED] = time;
+    it->second.success = true;
+    completed.push_back(it->second);
+    active.erase(it);
+    placed++;
+}
+
+/**
+ * @brief Percentile of a set of values with the nearest rank method, the values are reordered
+ *
+ * @param values
+ * @param p percentile in [0, 1]
+ * @return float
+ */
+float CellMetrics::percentile(vector<float>& values, float p){
+    if(values.empty()) return 0;
+    int rank = min((int)values.size() - 1, max(0, (int)ceil(p * values.size()) - 1));
+    nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank];
+}
+
+/**
+ * @brief Throughput and latency percentiles of the blocks placed in the window ending now
+ *
+ * @param now [s]
+ * @return MetricsSummary
+ */
+MetricsSummary CellMetrics::summary(double now){
+
+    while(!completed.empty() && completed.front().stamp[STAGE_ACKED] < now - window)
+        completed.pop_front();
+
+    MetricsSummary result;
+    result.blocksPlaced = placed;
+    result.blocksFailed = failed;
+
+    double elapsed = min(window, now - firstEvent);
+    result.blocksPerMinute = firstEvent > 0 && elapsed > 0 ? completed.size() * 60.0 / elapsed : 0;
+
+    //Intervals between consecutive stages, the last one is end to end
+    for(int s = 0; s < STAGE_COUNT; s++){
+        int from = s < STAGE_COUNT - 1 ? s : STAGE_REQUESTED;
+        int to = s < STAGE_COUNT - 1 ? s + 1 : STAGE_ACKED;
+
+        vector<float> durations;
+        for(int i = 0; i < completed.size(); i++)
+            if(completed[i].stamp[from] > 0 && completed[i].stamp[to] > 0)
+                durations.push_back(completed[i].stamp[to] - completed[i].stamp[from]);
+
+        result.intervals.push_back(string(STAGE_NAMES[from]) + " -> " + STAGE_NAMES[to]);
+        result.p50.push_back(percentile(durations, 0.5));
+        result.p90.push_back(percentile(durations, 0.9));
+        result.p99.push_back(percentile(durations, 0.99));
+    }
+
+    return result;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file fleetCell.cpp
+ * @author Matteo Mascherin
+ * @brief File containing a simulated cell of the fleet, with its own planner and world
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The state of the planner is global, so fleetCoordinator.cpp includes this file once per cell inside the namespace
+ * FLEET_CELL: every cell gets its own copy of the planner, of its simulated scene and arms and of its message bus, whose
+ * thread runs the callbacks of the cell. The coordinator only uses the hooks returned by cellHooks().
+ * Needs CellHooks to be declared before this file.
+ */
+
+namespace FLEET_CELL{
+
+#include "planner.cpp"
+#include "simulatedCell.cpp" // Simulated vision node and arms on the message bus
+
+///Number of arms of the cell
+int armCount = 1;
+
+/**
+ * @brief Hooks of the cell used by the coordinator
+ *
+ * @return CellHooks
+ */
+CellHooks cellHooks(){
+
+    CellHooks hooks;
+
+    hooks.start = [](int arms, double latency, double jitter, double timeScale){
+        armCount = arms;
+        armTimeScale = timeScale;
+        setupSimulatedCell(arms, latency, jitter);
+        bus.start();
+    };
+
+    hooks.stop = [](){
+        bus.stop();
+    };
+
+    hooks.deliver = [](int count, mt19937& random){
+        return addSceneBlocks(count, random);
+    };
+
+    //A cell that emptied its table stops asking for detections, it is woken up when blocks are delivered
+    hooks.wake = [](){
+        if(blocksOnTable() == 0) return;
+        lock_guard<mutex> guard(plannerLock);
+        if(detectionPending || !dispatcher.idle()) return;
+        sendDetectionRequest();
+        flushPlanner();
+    };
+
+    //Blocks waiting and orders in progress per arm
+    hooks.load = [](){
+        int busy = 0;
+        {
+            lock_guard<mutex> guard(plannerLock);
+            for(int a = 0; a < dispatcher.arms(); a++)
+                if(dispatcher.arm(a).blockInTransit >= 0) busy++;
+        }
+        return (double)(blocksOnTable() + busy) / armCount;
+    };
+
+    hooks.report = [](double now){
+        CellReport report;
+        {
+            lock_guard<mutex> guard(resultLock);
+            report.placed = placed;
+            report.failed = results - placed;
+        }
+        report.waiting = blocksOnTable();
+
+        lock_guard<mutex> guard(plannerLock);
+        MetricsSummary summary = metrics.summary(now);
+        report.blocksPerMinute = summary.blocksPerMinute;
+        report.p50 = summary.p50.empty() ? 0 : summary.p50.back();
+        report.p90 = summary.p90.empty() ? 0 : summary.p90.back();
+        return report;
+    };
+
+    return hooks;
+}
+
+}
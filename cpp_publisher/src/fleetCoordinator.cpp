@@ -0,0 +1,267 @@
+/**
+ * @file fleetCoordinator.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the coordinator running a fleet of simulated cells in a single process, for capacity planning
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Every cell has its own planner, world, arms and message bus, so the cells run in parallel on the cores of the host.
+ * The incoming work is a single stream of batches of blocks, ingested by the coordinator: every batch is delivered on
+ * the table of the least loaded cell, the one with the fewest blocks waiting or being moved per arm, and the cells left
+ * idle are woken up. The coordinator reports the throughput of every cell and of the whole fleet.
+ *
+ * Usage: fleet_coordinator [cells] [batches] [blocks per batch] [batch period s] [arms per cell] [arm time scale] [seed]
+ * The number of cells is at most FLEET_MAX_CELLS, the number of copies of the planner compiled in the coordinator.
+ */
+
+//Every header used by the planner and the simulated cell is included here, so that the copies of the cells in their
+//namespaces only hold the code of the project
+#include <iostream>
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <ros/serialization.h>
+#include <std_msgs/Bool.h>
+#include <cpp_publisher/CoordinatesV2.h>
+#include <cpp_publisher/Coordinates.h>
+#include <cpp_publisher/BlockInfo.h>
+#include <cpp_publisher/BlockInfoArray.h>
+#include <cpp_publisher/MoveOperationV2.h>
+#include <cpp_publisher/CellMetrics.h>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <queue>
+#include <unordered_map>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+using namespace std;
+
+///Maximum number of cells, one copy of the planner is compiled for each one
+#define FLEET_MAX_CELLS 8
+///Period of the coordinator loop [s]
+#define COORDINATOR_PERIOD 0.02
+///Period of the fleet report [s]
+#define FLEET_REPORT_PERIOD 5.0
+///Maximum duration of the run after the last batch [s]
+#define FLEET_TIMEOUT 120.0
+///Latency and jitter of the topics of every cell [s]
+#define FLEET_LATENCY 0.001
+#define FLEET_JITTER 0.0002
+
+/**
+ * @brief Struct to store the state of a cell reported to the coordinator
+ *
+ */
+struct CellReport{
+    int placed; // since the start
+    int failed; // since the start
+    int waiting; // blocks on the table
+    float blocksPerMinute;
+    float p50, p90; // end to end latency of the blocks [s]
+};
+
+/**
+ * @brief Struct to store the hooks of a cell, the only way the coordinator reaches the state of a cell
+ *
+ */
+struct CellHooks{
+    function<void(int arms, double latency, double jitter, double timeScale)> start; // Set up the cell and start its bus
+    function<void()> stop; // Stop the bus of the cell
+    function<int(int count, mt19937& random)> deliver; // Put blocks on the table of the cell
+    function<void()> wake; // Ask for a detection if the cell is idle with blocks on the table
+    function<double()> load; // Blocks waiting and orders in progress per arm
+    function<CellReport(double now)> report;
+};
+
+#define PLANNER_NODELET // the main function of the planner is not compiled
+
+#define FLEET_CELL cell0
+#include "fleetCell.cpp"
+#undef FLEET_CELL
+#define FLEET_CELL cell1
+#include "fleetCell.cpp"
+#undef FLEET_CELL
+#define FLEET_CELL cell2
+#include "fleetCell.cpp"
+#undef FLEET_CELL
+#define FLEET_CELL cell3
+#include "fleetCell.cpp"
+#undef FLEET_CELL
+#define FLEET_CELL cell4
+#include "fleetCell.cpp"
+#undef FLEET_CELL
+#define FLEET_CELL cell5
+#include "fleetCell.cpp"
+#undef FLEET_CELL
+#define FLEET_CELL cell6
+#include "fleetCell.cpp"
+#undef FLEET_CELL
+#define FLEET_CELL cell7
+#include "fleetCell.cpp"
+#undef FLEET_CELL
+
+/**
+ * @brief Stream buffer discarding everything, used to silence the planners of the cells
+ *
+ */
+class NullBuffer : public streambuf{
+protected:
+    int overflow(int c){ return c; }
+};
+
+/**
+ * @brief Time on the monotonic clock [s]
+ *
+ * @return double
+ */
+double fleetClock(){
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Print the state of every cell and the throughput of the fleet
+ *
+ * @param out
+ * @param fleet
+ * @param elapsed time since the start [s]
+ * @param delivered blocks delivered to the fleet
+ * @return int blocks placed by the fleet
+ */
+int printFleetReport(ostream& out, vector<CellHooks>& fleet, double elapsed, int delivered){
+
+    int placed = 0, failed = 0;
+    float blocksPerMinute = 0, worstP90 = 0;
+
+    for(int c = 0; c < fleet.size(); c++){
+        CellReport report = fleet[c].report(fleetClock());
+        placed += report.placed;
+        failed += report.failed;
+        blocksPerMinute += report.blocksPerMinute;
+        worstP90 = max(worstP90, report.p90);
+        out << "  cell " << c << ": placed " << report.placed << ", failed " << report.failed << ", waiting " << report.waiting
+            << ", " << report.blocksPerMinute << " blocks/min, end to end p50 " << report.p50 << " s p90 " << report.p90 << " s" << endl;
+    }
+
+    out << "Fleet at " << elapsed << " s: delivered " << delivered << ", placed " << placed << ", failed " << failed << ", "
+        << blocksPerMinute << " blocks/min, worst end to end p90 " << worstP90 << " s" << endl;
+    return placed;
+}
+
+int main(int argc, char **argv){
+
+    int cells = argc > 1 ? atoi(argv[1]) : 2;
+    int batches = argc > 2 ? atoi(argv[2]) : 10;
+    int batchSize = argc > 3 ? atoi(argv[3]) : 5;
+    double batchPeriod = argc > 4 ? atof(argv[4]) : 0.5;
+    int armsPerCell = argc > 5 ? max(1, atoi(argv[5])) : 1;
+    double armTimeScale = argc > 6 ? atof(argv[6]) : 0.01;
+    unsigned int seed = argc > 7 ? atoi(argv[7]) : 1;
+
+    //Every cell runs its own copy of the planner, a fleet larger than the copies compiled would run fewer cells than asked
+    if(cells < 1 || cells > FLEET_MAX_CELLS){
+        cerr << "The number of cells must be between 1 and " << FLEET_MAX_CELLS << ", raise FLEET_MAX_CELLS and add the copies"
+             << " of fleetCell.cpp to run " << cells << " cells" << endl;
+        return 1;
+    }
+
+    CellHooks hooks[FLEET_MAX_CELLS] = {cell0::cellHooks(), cell1::cellHooks(), cell2::cellHooks(), cell3::cellHooks(),
+                                        cell4::cellHooks(), cell5::cellHooks(), cell6::cellHooks(), cell7::cellHooks()};
+    vector<CellHooks> fleet(hooks, hooks + cells);
+
+    cout << "Running " << cells << " cells with " << armsPerCell << " arms, " << batches << " batches of " << batchSize
+         << " blocks every " << batchPeriod << " s, arm time scale " << armTimeScale << endl;
+
+    ros::Time::init();
+
+    NullBuffer nullBuffer;
+    streambuf* coutBuffer = cout.rdbuf();
+    cout.rdbuf(&nullBuffer);
+    ostream report(coutBuffer);
+
+    for(int c = 0; c < cells; c++)
+        fleet[c].start(armsPerCell, FLEET_LATENCY, FLEET_JITTER, armTimeScale);
+
+    //Shared ingestion: the batches arrive on a single stream and go to the least loaded cell
+    mt19937 random(seed);
+    vector<int> deliveredTo(cells, 0);
+    int delivered = 0, ingested = 0, placed = 0;
+    double start = fleetClock(), nextBatch = start, nextReport = start + FLEET_REPORT_PERIOD, lastBatch = start;
+
+    while(true){
+        double now = fleetClock();
+
+        if(ingested < batches && now >= nextBatch){
+            int target = 0;
+            double lowest = fleet[0].load();
+            for(int c = 1; c < cells; c++){
+                double load = fleet[c].load();
+                if(load < lowest){
+                    lowest = load;
+                    target = c;
+                }
+            }
+            int added = fleet[target].deliver(batchSize, random);
+            deliveredTo[target] += added;
+            delivered += added;
+            ingested++;
+            nextBatch += batchPeriod;
+            lastBatch = now;
+        }
+
+        for(int c = 0; c < cells; c++)
+            fleet[c].wake();
+
+        if(now >= nextReport){
+            placed = printFleetReport(report, fleet, now - start, delivered);
+            nextReport += FLEET_REPORT_PERIOD;
+        }else{
+            placed = 0;
+            for(int c = 0; c < cells; c++)
+                placed += fleet[c].report(now).placed;
+        }
+
+        if((ingested == batches && placed >= delivered) || now - lastBatch > FLEET_TIMEOUT)
+            break;
+
+        usleep(COORDINATOR_PERIOD * 1e6);
+    }
+
+    double wallTime = fleetClock() - start;
+    for(int c = 0; c < cells; c++)
+        fleet[c].stop();
+
+    report << "Final state:" << endl;
+    placed = printFleetReport(report, fleet, wallTime, delivered);
+    for(int c = 0; c < cells; c++)
+        report << "  cell " << c << ": " << deliveredTo[c] << " blocks delivered" << endl;
+    report << "Placed " << placed << "/" << delivered << " blocks in " << wallTime << " s (" << placed * 60 / wallTime
+           << " blocks per minute over the whole run)" << endl;
+
+    cout.rdbuf(coutBuffer);
+    return placed == delivered ? 0 : 1;
+}
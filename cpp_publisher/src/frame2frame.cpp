@@ -19,6 +19,8 @@
 using namespace std;
 
 Eigen::Vector3f transformationWorldToBase(Eigen::Vector3f pointInWorldFrame);
+Eigen::Vector3f transformationBaseToWorld(Eigen::Vector3f pointInBaseFrame);
+float yawWorldToBase(float yawInWorldFrame);
 
 /**
  * @brief takes a position in the world frame and returns the position in the base frame
@@ -41,3 +43,33 @@ Eigen::Vector3f transformationWorldToBase(Eigen::Vector3f pointInWorldFrame){
 
     return pointInBaseFrame;
 }
+
+/**
+ * @brief takes a position in the base frame and returns the position in the world frame
+ * 
+ * @param pointInBaseFrame 
+ * @return Eigen::Vector3f 
+ */
+Eigen::Vector3f transformationBaseToWorld(Eigen::Vector3f pointInBaseFrame){
+
+    //Same traslation and rotation of transformationWorldToBase
+    Eigen::Vector3f t(-0.5, 0.35, 1.75);
+    Eigen::AngleAxisf r(M_PI, Eigen::Vector3f::UnitX());
+
+    Eigen::Affine3f transformation(r);
+    transformation.pretranslate(t);
+
+    return transformation.inverse() * pointInBaseFrame;
+}
+
+/**
+ * @brief takes a rotation about the z axis of the world frame and returns the rotation about the z axis of the base frame
+ * 
+ * @param yawInWorldFrame 
+ * @return float 
+ */
+float yawWorldToBase(float yawInWorldFrame){
+
+    //The base frame is rotated of pi about x, its z axis points down
+    return -yawInWorldFrame;
+}
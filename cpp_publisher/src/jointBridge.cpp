@@ -0,0 +1,93 @@
+/**
+ * @file jointBridge.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the controller side bridge of the shared memory channel of the joint commands
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The bridge creates the channel, waits for the commands written by the move node and forwards the last one to the
+ * joint group controller. It has to run on the same host as the controller and be started before the move node,
+ * otherwise the move node publishes the commands on the topic as usual.
+ * The bridge also subscribes to the compact joint commands, used by the move node when it runs on another host, and
+ * converts them to the layout of the controller topic.
+ */
+
+#include <iostream>
+#include <algorithm>
+
+#include <ros/ros.h>
+#include <std_msgs/Float64MultiArray.h>
+#include <cpp_publisher/JointCommand.h> // Message type with a fixed layout for the joint commands
+
+#include "jointChannel.cpp" // Shared memory channel of the joint commands
+
+///Timeout of the wait for a command, to serve the new move nodes and check for shutdown [ms]
+#define BRIDGE_WAIT_TIMEOUT 100
+
+using namespace std;
+
+///Publisher for the joint group controller
+ros::Publisher controllerPublisher;
+///Compact command converted to the layout of the controller topic, preallocated
+std_msgs::Float64MultiArray compactMsg;
+
+void jointCommandCallback(const cpp_publisher::JointCommand::ConstPtr& command); // Forward a compact joint command to the controller
+
+int main(int argc, char **argv){
+
+    ros::init(argc, argv, "joint_bridge");
+    ros::NodeHandle node;
+
+    controllerPublisher = node.advertise<std_msgs::Float64MultiArray>("/ur5/joint_group_pos_controller/command", 1);
+
+    //The compact commands are received on their own thread, the main loop waits on the channel
+    ros::Subscriber commandSubscriber = node.subscribe("/move/joint_command", 1, jointCommandCallback, ros::TransportHints().tcpNoDelay());
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
+
+    JointChannel channel;
+    if(!channel.create())
+        return 1;
+
+    cout << "Joint command bridge ready" << endl;
+
+    //Preallocated message, resized only if the number of joints changes
+    std_msgs::Float64MultiArray msg;
+    JointSample sample;
+    uint32_t lastSequence = 0;
+
+    while(ros::ok()){
+        channel.serveClients();
+
+        if(!channel.wait(BRIDGE_WAIT_TIMEOUT) || !channel.read(sample) || sample.sequence == lastSequence)
+            continue;
+        lastSequence = sample.sequence;
+
+        msg.data.resize(sample.count);
+        for(int i = 0; i < sample.count; i++)
+            msg.data[i] = sample.values[i];
+        controllerPublisher.publish(msg);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Forward a compact joint command to the controller, the converted message is resized only if the gripper changes
+ *
+ * @param command
+ */
+void jointCommandCallback(const cpp_publisher::JointCommand::ConstPtr& command){
+
+    //The number of gripper joints comes from the wire, it cannot exceed the fixed array
+    int gripperJoints = min((int)command->gripperJoints, (int)command->gripper.size());
+    int count = command->joints.size() + gripperJoints;
+    if(compactMsg.data.size() != count) compactMsg.data.resize(count);
+
+    copy(command->joints.begin(), command->joints.end(), compactMsg.data.begin());
+    copy(command->gripper.begin(), command->gripper.begin() + gripperJoints, compactMsg.data.begin() + command->joints.size());
+
+    controllerPublisher.publish(compactMsg);
+}
@@ -0,0 +1,382 @@
+/**
+ * @file jointChannel.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the shared memory channel carrying the joint commands from the move node to the controller side
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The channel is a single slot in shared memory protected by a seqlock: the writer makes the sequence odd, writes the
+ * values and makes it even again, the reader retries if the sequence was odd or changed while it was copying. Only the
+ * last command matters to a position controller, so older commands are overwritten instead of queued. Every write is
+ * notified on an eventfd, so that the reader can sleep instead of polling.
+ * The controller side creates the slot and the eventfd, the eventfd is handed to the move node through a Unix socket.
+ * The abstract socket is released by the kernel when its process dies, so binding it tells whether another controller
+ * side is serving the channel: only then the slot is created again, from scratch, and a writer still mapping the old one
+ * sees its heartbeat stop and connects again.
+ */
+
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <cerrno>
+#include <cstddef>
+#include <new>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+///Name of the shared memory object of the slot, the abstract Unix socket handing out the eventfd has the same name
+#define JOINT_CHANNEL_NAME "/cpp_publisher_joint_command"
+///Maximum number of values in a command
+#define JOINT_CHANNEL_VALUES 16
+///Time without signs of life from the reader after which the writer considers it gone [s]
+#define JOINT_CHANNEL_TIMEOUT 1.0
+
+/**
+ * @brief Struct to store the slot shared by the two processes, every field is a lock free atomic
+ *
+ */
+struct JointSlot{
+    atomic<uint32_t> sequence; // odd while the writer is updating the slot
+    atomic<uint32_t> count; // number of values
+    atomic<double> stamp; // time of the write, monotonic clock [s]
+    atomic<double> heartbeat; // last time the reader waited for a command, monotonic clock [s]
+    atomic<double> values[JOINT_CHANNEL_VALUES];
+};
+
+/**
+ * @brief Struct to store a command read from the slot
+ *
+ */
+struct JointSample{
+    uint32_t sequence;
+    int count;
+    double stamp;
+    double values[JOINT_CHANNEL_VALUES];
+};
+
+/**
+ * @brief Shared memory channel of the joint commands, with a single writer (the move node) and a single reader (the controller side)
+ *
+ */
+class JointChannel{
+public:
+    JointChannel(const string& name = JOINT_CHANNEL_NAME);
+    ~JointChannel();
+
+    bool create(); // Controller side: create the slot and the eventfd and wait for the move node
+    void serveClients(); // Controller side: hand the eventfd to the move nodes that connected
+    bool wait(int timeout); // Controller side: wait for a new command
+    bool read(JointSample& sample) const; // Controller side: read the last command
+
+    bool connect(); // Move node side: open the slot created by the controller side
+    void write(const double* values, int count); // Move node side: write a command and notify it
+
+    bool connected() const; // True if the slot is mapped
+    bool readerAlive() const; // True if the controller side is still reading the slot
+    static double now(); // Time on the clock used for the stamps [s]
+
+private:
+    string name; // name of the shared memory object, starting with /
+    JointSlot* slot;
+    int eventFd;
+    int listenFd; // socket handing out the eventfd, controller side only
+    bool owner; // true on the side that created the slot
+
+    socklen_t socketAddress(sockaddr_un& address) const;
+    void disconnect(); // Unmap the slot and close the eventfd
+};
+
+/**
+ * @brief Construct a channel not connected yet
+ *
+ * @param name name of the shared memory object, starting with /. Tests use their own name, not to touch the channel of
+ * a running move node
+ */
+JointChannel::JointChannel(const string& name) : name(name){
+    slot = NULL;
+    eventFd = -1;
+    listenFd = -1;
+    owner = false;
+}
+
+/**
+ * @brief Unmap the slot and close the descriptors, the side that created the slot also removes it
+ *
+ */
+JointChannel::~JointChannel(){
+    disconnect();
+    if(listenFd >= 0) close(listenFd);
+    if(owner) shm_unlink(name.c_str());
+}
+
+/**
+ * @brief Unmap the slot and close the eventfd
+ *
+ */
+void JointChannel::disconnect(){
+    if(slot) munmap(slot, sizeof(JointSlot));
+    if(eventFd >= 0) close(eventFd);
+    slot = NULL;
+    eventFd = -1;
+}
+
+/**
+ * @brief Fill the address of the abstract socket handing out the eventfd
+ *
+ * @param address
+ * @return socklen_t length of the address
+ */
+socklen_t JointChannel::socketAddress(sockaddr_un& address) const{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    string socketName = name.substr(1, sizeof(address.sun_path) - 2);
+    memcpy(address.sun_path + 1, socketName.data(), socketName.size()); //leading 0: abstract namespace
+    return offsetof(sockaddr_un, sun_path) + 1 + socketName.size();
+}
+
+/**
+ * @brief Time on the monotonic clock, shared by every process of the host [s]
+ *
+ * @return double
+ */
+double JointChannel::now(){
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief True if the slot is mapped
+ *
+ * @return true
+ * @return false
+ */
+bool JointChannel::connected() const{
+    return slot != NULL;
+}
+
+/**
+ * @brief True if the controller side waited for a command recently, the writer should fall back to the topic otherwise
+ *
+ * @return true
+ * @return false
+ */
+bool JointChannel::readerAlive() const{
+    return slot && now() - slot->heartbeat.load(memory_order_relaxed) < JOINT_CHANNEL_TIMEOUT;
+}
+
+/**
+ * @brief Create the slot and the eventfd and listen for the move node, called by the controller side. It fails if
+ * another controller side is serving the channel, its slot is left untouched
+ *
+ * @return true if the channel is ready
+ */
+bool JointChannel::create(){
+
+    if(!atomic<double>().is_lock_free() || !atomic<uint32_t>().is_lock_free()){
+        cout << "Shared memory channel needs lock free atomics" << endl;
+        return false;
+    }
+
+    //The socket is bound first: it is in use only while the controller side that bound it is alive
+    sockaddr_un address;
+    socklen_t length = socketAddress(address);
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listenFd < 0 || bind(listenFd, (sockaddr*)&address, length) < 0 || listen(listenFd, 4) < 0){
+        if(errno == EADDRINUSE) cout << "The channel " << name << " is already served by another process" << endl;
+        else cout << "Cannot open the notification socket: " << strerror(errno) << endl;
+        return false;
+    }
+
+    //A slot left by a controller side that died is replaced by a new one, its writers reconnect when its heartbeat stops
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(fd < 0 || ftruncate(fd, sizeof(JointSlot)) < 0){
+        cout << "Cannot create shared memory " << name << ": " << strerror(errno) << endl;
+        if(fd >= 0) close(fd);
+        return false;
+    }
+    void* memory = mmap(NULL, sizeof(JointSlot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(memory == MAP_FAILED) return false;
+
+    slot = new(memory) JointSlot();
+    slot->sequence = 0;
+    slot->count = 0;
+    slot->heartbeat = now();
+    owner = true;
+
+    eventFd = eventfd(0, EFD_CLOEXEC);
+    if(eventFd < 0){
+        cout << "Cannot create the eventfd: " << strerror(errno) << endl;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Hand the eventfd to the move nodes waiting on the socket, it never blocks
+ *
+ */
+void JointChannel::serveClients(){
+
+    int client;
+    while((client = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC)) >= 0){
+
+        char data = 0;
+        iovec io = {&data, 1};
+        char control[CMSG_SPACE(sizeof(int))];
+        memset(control, 0, sizeof(control));
+
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &io;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(header), &eventFd, sizeof(int));
+
+        if(sendmsg(client, &message, 0) < 0)
+            cout << "Cannot send the eventfd: " << strerror(errno) << endl;
+        close(client);
+    }
+}
+
+/**
+ * @brief Open the slot created by the controller side and receive its eventfd, called by the move node. Called again
+ * after the controller side restarted, it replaces the slot and the eventfd of the previous one
+ *
+ * @return true if the controller side is running
+ */
+bool JointChannel::connect(){
+
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if(fd < 0) return false;
+    void* memory = mmap(NULL, sizeof(JointSlot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(memory == MAP_FAILED) return false;
+
+    sockaddr_un address;
+    socklen_t length = socketAddress(address);
+    int socketFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(socketFd < 0 || ::connect(socketFd, (sockaddr*)&address, length) < 0){
+        if(socketFd >= 0) close(socketFd);
+        munmap(memory, sizeof(JointSlot));
+        return false;
+    }
+
+    char data;
+    iovec io = {&data, 1};
+    char control[CMSG_SPACE(sizeof(int))];
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    //The controller side answers from its loop, wait for it a bounded time
+    pollfd request = {socketFd, POLLIN, 0};
+    bool received = poll(&request, 1, 1000) > 0 && recvmsg(socketFd, &message, 0) > 0;
+    close(socketFd);
+
+    cmsghdr* header = received ? CMSG_FIRSTHDR(&message) : NULL;
+    if(!header || header->cmsg_type != SCM_RIGHTS){
+        munmap(memory, sizeof(JointSlot));
+        return false;
+    }
+
+    disconnect();
+    memcpy(&eventFd, CMSG_DATA(header), sizeof(int));
+    slot = (JointSlot*)memory;
+    return true;
+}
+
+/**
+ * @brief Write a command in the slot and notify the controller side, it never blocks
+ *
+ * @param values
+ * @param count number of values, at most JOINT_CHANNEL_VALUES
+ */
+void JointChannel::write(const double* values, int count){
+
+    count = min(count, JOINT_CHANNEL_VALUES);
+
+    uint32_t sequence = slot->sequence.load(memory_order_relaxed);
+    slot->sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->count.store(count, memory_order_relaxed);
+    slot->stamp.store(now(), memory_order_relaxed);
+    for(int i = 0; i < count; i++)
+        slot->values[i].store(values[i], memory_order_relaxed);
+
+    slot->sequence.store(sequence + 2, memory_order_release);
+
+    uint64_t one = 1;
+    if(::write(eventFd, &one, sizeof(one)) < 0)
+        cout << "Cannot notify the joint command: " << strerror(errno) << endl;
+}
+
+/**
+ * @brief Wait for the notification of a new command, telling the writer that the reader is alive
+ *
+ * @param timeout [ms], at most JOINT_CHANNEL_TIMEOUT
+ * @return true if a command was written since the last wait
+ */
+bool JointChannel::wait(int timeout){
+
+    slot->heartbeat.store(now(), memory_order_relaxed);
+
+    pollfd event = {eventFd, POLLIN, 0};
+    if(poll(&event, 1, timeout) <= 0) return false;
+
+    uint64_t writes;
+    return ::read(eventFd, &writes, sizeof(writes)) == sizeof(writes);
+}
+
+/**
+ * @brief Read the last command written, retrying while the writer is updating the slot
+ *
+ * @param sample
+ * @return true if at least one command was written
+ */
+bool JointChannel::read(JointSample& sample) const{
+
+    uint32_t before, after;
+    do{
+        before = slot->sequence.load(memory_order_acquire);
+        if(before & 1) continue;
+
+        sample.count = slot->count.load(memory_order_relaxed);
+        sample.stamp = slot->stamp.load(memory_order_relaxed);
+        for(int i = 0; i < sample.count && i < JOINT_CHANNEL_VALUES; i++)
+            sample.values[i] = slot->values[i].load(memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+        after = slot->sequence.load(memory_order_relaxed);
+    }while((before & 1) || before != after);
+
+    sample.sequence = before;
+    return before != 0;
+}
@@ -0,0 +1,186 @@
+/**
+ * @file jointChannelBenchmark.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the benchmark comparing the latency of the joint commands on the shared memory channel and on a ROS topic
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * A writer process sends commands at the rate of the move node to a reader process, which measures the time between
+ * the write and the read on the monotonic clock. The channel keeps only the last command, so the reader may miss some of
+ * them: the writer ends the run with a marker command and the reader stops at it, or at a deadline if it never sees it.
+ * The channel has a name of its own, so the benchmark can run next to a joint bridge and a move node.
+ * The ROS topic is measured only if a master is running.
+ * Usage: joint_channel_benchmark [samples]
+ */
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+#include <ros/ros.h>
+#include <std_msgs/Float64MultiArray.h>
+#include <sys/wait.h>
+
+#include "jointChannel.cpp" // Shared memory channel of the joint commands
+
+///Rate of the commands, the same of the move node [Hz]
+#define BENCHMARK_RATE 1000
+///Values in a command: 6 joints and 3 gripper joints
+#define BENCHMARK_VALUES 9
+///Commands sent before the measure starts
+#define BENCHMARK_WARMUP 100
+///First value of the command ending the run
+#define BENCHMARK_END -1.0
+///Time the reader waits for the end of the run after the expected one [s]
+#define BENCHMARK_GRACE 10.0
+
+using namespace std;
+
+void printLatency(string transport, vector<double>& latency); // Print the percentiles of the latency
+void benchmarkChannel(int samples); // Measure the shared memory channel
+void benchmarkTopic(int samples, int argc, char **argv); // Measure the ROS topic
+
+int main(int argc, char **argv){
+
+    int samples = argc > 1 ? atoi(argv[1]) : 10000;
+
+    benchmarkChannel(samples);
+    benchmarkTopic(samples, argc, argv);
+
+    return 0;
+}
+
+/**
+ * @brief Print the percentiles of the latency
+ *
+ * @param transport
+ * @param latency [s]
+ */
+void printLatency(string transport, vector<double>& latency){
+
+    if(latency.empty()){
+        cout << transport << ": no samples" << endl;
+        return;
+    }
+
+    sort(latency.begin(), latency.end());
+    auto percentile = [&](double p){ return latency[min(latency.size() - 1, (size_t)(p * latency.size()))] * 1e6; };
+
+    cout << transport << ": " << latency.size() << " samples, p50 " << percentile(0.5) << " us, p90 " << percentile(0.9)
+         << " us, p99 " << percentile(0.99) << " us, max " << latency.back() * 1e6 << " us" << endl;
+}
+
+/**
+ * @brief Measure the shared memory channel: the child process creates it and reads, the parent writes
+ *
+ * @param samples
+ */
+void benchmarkChannel(int samples){
+
+    int ready[2];
+    if(pipe(ready) < 0) return;
+
+    string name = string(JOINT_CHANNEL_NAME) + "_benchmark_" + to_string(getpid());
+
+    pid_t reader = fork();
+    if(reader == 0){
+        JointChannel channel(name);
+        char created = channel.create();
+        if(::write(ready[1], &created, 1) < 0 || !created) _exit(1);
+
+        vector<double> latency;
+        JointSample sample;
+        uint32_t lastSequence = 0;
+        int received = 0;
+        double deadline = JointChannel::now() + (samples + BENCHMARK_WARMUP) * 2.0 / BENCHMARK_RATE + BENCHMARK_GRACE;
+        while(JointChannel::now() < deadline){
+            channel.serveClients();
+            if(!channel.wait(100)) continue;
+            double now = JointChannel::now();
+            if(!channel.read(sample) || sample.sequence == lastSequence) continue;
+            lastSequence = sample.sequence;
+            if(sample.values[0] == BENCHMARK_END) break;
+            if(received++ >= BENCHMARK_WARMUP) latency.push_back(now - sample.stamp);
+        }
+        printLatency("shared memory", latency);
+        cout << "shared memory: " << max(0, samples + BENCHMARK_WARMUP - received) << " commands overwritten before being read" << endl;
+        _exit(0);
+    }
+
+    char created = 0;
+    if(::read(ready[0], &created, 1) < 1 || !created){
+        cout << "Cannot create the shared memory channel" << endl;
+        waitpid(reader, NULL, 0);
+        return;
+    }
+
+    JointChannel channel(name);
+    while(!channel.connect()) usleep(1000);
+
+    double values[BENCHMARK_VALUES] = {0};
+    for(int i = 0; i < samples + BENCHMARK_WARMUP; i++){
+        values[0] = i;
+        channel.write(values, BENCHMARK_VALUES);
+        usleep(1000000 / BENCHMARK_RATE);
+    }
+
+    //The last command stays in the slot, the reader sees the marker even if it missed the commands before it
+    values[0] = BENCHMARK_END;
+    channel.write(values, BENCHMARK_VALUES);
+
+    waitpid(reader, NULL, 0);
+}
+
+/**
+ * @brief Measure the ROS topic: the child process subscribes, the parent publishes with the write time in the last value
+ *
+ * @param samples
+ * @param argc
+ * @param argv
+ */
+void benchmarkTopic(int samples, int argc, char **argv){
+
+    //Each process initialises ROS after the fork, with its own node name
+    pid_t reader = fork();
+    if(reader == 0){
+        ros::init(argc, argv, "joint_channel_benchmark_reader", ros::init_options::AnonymousName);
+        if(!ros::master::check()) _exit(1);
+        ros::NodeHandle node;
+        vector<double> latency;
+        int received = 0;
+        boost::function<void(const std_msgs::Float64MultiArray::ConstPtr&)> callback = [&](const std_msgs::Float64MultiArray::ConstPtr& msg){
+            if(received++ >= BENCHMARK_WARMUP) latency.push_back(JointChannel::now() - msg->data.back());
+        };
+        ros::Subscriber subscriber = node.subscribe("/joint_channel_benchmark", 1000, callback, ros::VoidConstPtr(), ros::TransportHints().tcpNoDelay());
+        ros::Time start = ros::Time::now();
+        while(ros::ok() && received < samples + BENCHMARK_WARMUP && ros::Time::now() - start < ros::Duration(samples * 2.0 / BENCHMARK_RATE + 10))
+            ros::spinOnce();
+        printLatency("ROS topic", latency);
+        _exit(0);
+    }
+
+    ros::init(argc, argv, "joint_channel_benchmark_writer", ros::init_options::AnonymousName);
+    if(!ros::master::check()){
+        cout << "ROS topic: no master running, skipped" << endl;
+        waitpid(reader, NULL, 0);
+        return;
+    }
+
+    ros::NodeHandle node;
+    ros::Publisher publisher = node.advertise<std_msgs::Float64MultiArray>("/joint_channel_benchmark", 1000);
+    while(ros::ok() && publisher.getNumSubscribers() == 0) usleep(1000);
+
+    std_msgs::Float64MultiArray msg;
+    msg.data.resize(BENCHMARK_VALUES + 1);
+    for(int i = 0; i < samples + BENCHMARK_WARMUP; i++){
+        msg.data[0] = i;
+        msg.data[BENCHMARK_VALUES] = JointChannel::now();
+        publisher.publish(msg);
+        usleep(1000000 / BENCHMARK_RATE);
+    }
+
+    waitpid(reader, NULL, 0);
+}
@@ -0,0 +1,263 @@
+/**
+ * @file messageBus.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the in-process message bus standing in for the ROS topics in the benchmarks
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The bus delivers the messages by topic name, with the same message types used on the ROS topics, to the callbacks
+ * subscribed in the same process. Every delivery is scheduled at the time of the publication plus the latency of the
+ * topic, drawn from a normal distribution, and a single dispatcher thread runs the callbacks in order of delivery time,
+ * like ros::spin() does for a node. A publisher can also delay a message on purpose, for example to simulate the
+ * time spent by the arm on a move order.
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <queue>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <random>
+
+#include <boost/shared_ptr.hpp>
+
+using namespace std;
+
+/**
+ * @brief Struct to store the latency injected on a topic
+ *
+ */
+struct TopicLatency{
+    double mean; // [s]
+    double jitter; // standard deviation [s]
+};
+
+/**
+ * @brief Struct to store the statistics of a topic
+ *
+ */
+struct BusStats{
+    int delivered;
+    double lateness; // total time between the scheduled delivery and the start of the callback [s]
+};
+
+/**
+ * @brief In-process publish/subscribe bus with latency injection
+ *
+ */
+class MessageBus{
+public:
+    MessageBus(unsigned int seed = 0);
+    ~MessageBus();
+
+    void setLatency(const string& topic, double mean, double jitter = 0); // Latency of the deliveries on a topic [s]
+    template<class M> void subscribe(const string& topic, function<void(const boost::shared_ptr<const M>&)> callback); // Subscribe a callback to a topic
+    template<class M> void publish(const string& topic, const boost::shared_ptr<const M>& msg, double delay = 0); // Publish a message, delivered after the latency of the topic plus a delay [s]
+    int getNumSubscribers(const string& topic);
+
+    void start(); // Start the dispatcher thread
+    void stop(); // Stop the dispatcher thread, the deliveries not run yet are dropped
+    map<string, BusStats> stats(); // Statistics of every topic
+
+private:
+    typedef chrono::steady_clock::time_point TimePoint;
+
+    /**
+     * @brief Struct to store a scheduled delivery, ordered by time and then by publication
+     *
+     */
+    struct Delivery{
+        TimePoint time;
+        unsigned long sequence;
+        string topic;
+        function<void()> run;
+        bool operator>(const Delivery& other) const{ return time > other.time || (time == other.time && sequence > other.sequence); }
+    };
+
+    map<string, vector<function<void(const boost::shared_ptr<const void>&)>>> subscribers;
+    map<string, TopicLatency> latency;
+    map<string, BusStats> topicStats;
+    priority_queue<Delivery, vector<Delivery>, greater<Delivery>> deliveries;
+    unsigned long published;
+    mt19937 random;
+
+    mutex lock;
+    condition_variable changed;
+    thread dispatcher;
+    bool running;
+
+    void dispatchLoop();
+};
+
+/**
+ * @brief Construct a bus with no latency on every topic
+ *
+ * @param seed seed of the latency jitter, the same seed gives the same latencies
+ */
+MessageBus::MessageBus(unsigned int seed) : random(seed){
+    published = 0;
+    running = false;
+}
+
+/**
+ * @brief Stop the dispatcher thread
+ *
+ */
+MessageBus::~MessageBus(){
+    stop();
+}
+
+/**
+ * @brief Set the latency of the deliveries on a topic, the topics without a latency deliver immediately
+ *
+ * @param topic
+ * @param mean [s]
+ * @param jitter standard deviation [s]
+ */
+void MessageBus::setLatency(const string& topic, double mean, double jitter){
+    lock_guard<mutex> guard(lock);
+    latency[topic] = {mean, jitter};
+}
+
+/**
+ * @brief Subscribe a callback to a topic, it runs on the dispatcher thread
+ *
+ * @tparam M message type, it must be the one published on the topic
+ * @param topic
+ * @param callback
+ */
+template<class M> void MessageBus::subscribe(const string& topic, function<void(const boost::shared_ptr<const M>&)> callback){
+    lock_guard<mutex> guard(lock);
+    subscribers[topic].push_back([callback](const boost::shared_ptr<const void>& msg){
+        callback(boost::static_pointer_cast<const M>(msg));
+    });
+}
+
+/**
+ * @brief Number of callbacks subscribed to a topic
+ *
+ * @param topic
+ * @return int
+ */
+int MessageBus::getNumSubscribers(const string& topic){
+    lock_guard<mutex> guard(lock);
+    auto it = subscribers.find(topic);
+    return it == subscribers.end() ? 0 : it->second.size();
+}
+
+/**
+ * @brief Publish a message to the subscribers of a topic. Every subscriber receives the same instance, as with
+ * the intra-process publications of ROS, after the latency of the topic plus the given delay
+ *
+ * @tparam M message type
+ * @param topic
+ * @param msg
+ * @param delay additional delay of the delivery [s]
+ */
+template<class M> void MessageBus::publish(const string& topic, const boost::shared_ptr<const M>& msg, double delay){
+
+    lock_guard<mutex> guard(lock);
+
+    auto it = subscribers.find(topic);
+    if(it == subscribers.end()) return;
+
+    TopicLatency topicLatency = latency.count(topic) ? latency[topic] : TopicLatency{0, 0};
+    double total = delay + topicLatency.mean;
+    if(topicLatency.jitter > 0)
+        total += normal_distribution<double>(0, topicLatency.jitter)(random);
+
+    Delivery delivery;
+    delivery.time = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(max(0.0, total)));
+    delivery.sequence = published++;
+    delivery.topic = topic;
+
+    boost::shared_ptr<const void> erased = msg;
+    vector<function<void(const boost::shared_ptr<const void>&)>> callbacks = it->second;
+    delivery.run = [callbacks, erased](){
+        for(int i = 0; i < callbacks.size(); i++)
+            callbacks[i](erased);
+    };
+
+    deliveries.push(delivery);
+    changed.notify_one();
+}
+
+/**
+ * @brief Start the dispatcher thread running the callbacks
+ *
+ */
+void MessageBus::start(){
+    lock_guard<mutex> guard(lock);
+    if(running) return;
+    running = true;
+    dispatcher = thread(&MessageBus::dispatchLoop, this);
+}
+
+/**
+ * @brief Stop the dispatcher thread after the callback running, the deliveries not run yet are dropped
+ *
+ */
+void MessageBus::stop(){
+    {
+        lock_guard<mutex> guard(lock);
+        if(!running) return;
+        running = false;
+    }
+    changed.notify_one();
+    if(dispatcher.joinable() && dispatcher.get_id() != this_thread::get_id())
+        dispatcher.join();
+    else if(dispatcher.joinable())
+        dispatcher.detach();
+}
+
+/**
+ * @brief Statistics of every topic delivered so far
+ *
+ * @return map<string, BusStats>
+ */
+map<string, BusStats> MessageBus::stats(){
+    lock_guard<mutex> guard(lock);
+    return topicStats;
+}
+
+/**
+ * @brief Loop of the dispatcher thread: wait for the earliest delivery and run its callbacks without holding the lock,
+ * so that the callbacks can publish
+ *
+ */
+void MessageBus::dispatchLoop(){
+
+    unique_lock<mutex> guard(lock);
+
+    while(running){
+
+        if(deliveries.empty()){
+            changed.wait(guard);
+            continue;
+        }
+
+        TimePoint due = deliveries.top().time;
+        if(chrono::steady_clock::now() < due){
+            changed.wait_until(guard, due);
+            continue;
+        }
+
+        Delivery delivery = deliveries.top();
+        deliveries.pop();
+
+        BusStats& stats = topicStats[delivery.topic];
+        stats.delivered++;
+        stats.lateness += chrono::duration<double>(chrono::steady_clock::now() - delivery.time).count();
+
+        guard.unlock();
+        delivery.run();
+        guard.lock();
+    }
+}
@@ -18,12 +18,19 @@
 #include <std_msgs/Byte.h>
 #include <std_msgs/String.h>
 #include <sensor_msgs/JointState.h> // Message type for joint states
-#include <cpp_publisher/Coordinates.h> // Message type for move node with coordinates of the block, target zone and block id
-#include <cpp_publisher/MoveOperation.h> // Message type for move node with the result of the movement
+#include <cpp_publisher/CoordinatesV2.h> // Message type for move node with coordinates of the block, target zone, block id and trace id
+#include <cpp_publisher/MoveOperationV2.h> // Message type for move node with the result of the movement
+#include <cpp_publisher/MoveOperation.h> // Original message type of the result, still published for the tools using it
+#include <cpp_publisher/JointCommand.h> // Message type with a fixed layout for the joint commands
 #include <ros_impedance_controller/generic_float.h>
 
 #include "kinematicsUr5.cpp" // Kinematics of the UR5, used for inverse and forward kinematics
 #include "frame2frame.cpp" // Functions for frame to frame transformations (world to EE)
+#include "jointChannel.cpp" // Shared memory channel of the joint commands
+#include "sessionLog.cpp" // Binary log of the messages received
+#include "workspaceReservation.cpp" // Reservations of the workspace shared with the other arms
+#include "poseFilter.cpp" // Covariance of the detections, the threshold of the fast approach is set from it
+#include "pickOrder.cpp" // Waypoints and times of an order, the corridor is reserved along them
 
 ///Flag to slow down the movement process
 #define DEBUG 0
@@ -38,6 +45,13 @@
 #define MOVEMENT_VELOCITY 0.3
 ///Velocity while approaching the block [m/s]
 #define APPROACH_VELOCITY 0.1
+///Velocity while approaching a block whose position is known precisely [m/s]
+#define FAST_APPROACH_VELOCITY 0.2
+///Confidence of a single detection whose position is precise enough for the fast approach
+#define FAST_APPROACH_CONFIDENCE 0.8
+///Standard deviation on the table plane of the block position under which the fast approach is used, the one of a single
+///detection with FAST_APPROACH_CONFIDENCE: a block is approached fast after one detection above it, or two fused ones above 0.4 [m]
+#define FAST_APPROACH_SIGMA (DETECTION_SIGMA_XY / sqrt(FAST_APPROACH_CONFIDENCE))
 ///Number of joints of the robot
 #define ROBOT_JOINTS 6
 ///Number of joints of the soft gripper
@@ -47,6 +61,32 @@
 
 ///Flag to enable the hard gripper
 #define HARD_GRIPPER 1
+///Flag to send the joint commands on the shared memory channel when the joint bridge is running
+#define JOINT_CHANNEL 1
+///Flag to send the joint commands with the compact message when the joint bridge subscribes to it
+#define COMPACT_JOINT_COMMAND 1
+
+///Height of the placements on the table sent by the planner, higher placements are on top of other blocks
+#define TABLE_PLACE_HEIGHT 0.9
+
+///Set to 1 to reserve the corridor of the arm in the table shared with the other arms before executing an order
+#define RESERVE_WORKSPACE 1
+///Distance kept between the arm and the corridors of the other arms [m]
+#define CORRIDOR_RADIUS 0.1
+///Factor bounding the real time of a segment of an order from its estimated time
+#define RESERVATION_SLACK 1.5
+///Time added to the end of the window of every segment of an order [s]
+#define RESERVATION_MARGIN 2.0
+///Time the end of an order stays reserved while the arm waits there for the next order or the park move [s]
+#define END_RESERVATION_TIME 30.0
+///Time an order waits for its corridor before it is given back to the planner [s]
+#define RESERVATION_WAIT 20.0
+///Period of the checks of the corridor while waiting for it [us]
+#define RESERVATION_POLL 50000
+///Time without orders after which the arm leaves the target area for its waiting position [s]
+#define PARK_DELAY 1.0
+///Upper bound of the time of the movement to the waiting position [s]
+#define PARK_RESERVATION_TIME 10.0
 
 using namespace std;
 using Eigen::MatrixXf;
@@ -57,14 +97,41 @@ using Eigen::Vector3f;
 ros::Publisher pub_des_jstate;
 ///Publisher for the result of the movement to be sent to the planner
 ros::Publisher pub_move_operation;
+///Publisher for the progress of the movement to be sent to the planner
+ros::Publisher pub_move_progress;
+///Publishers of the results and progress in the original message, on the original topics
+ros::Publisher pub_legacy_operation, pub_legacy_progress;
+///Publisher for the compact joint commands, forwarded to the controller by the joint bridge
+ros::Publisher pub_joint_command;
+///Shared memory channel of the joint commands, used instead of the topic while the joint bridge reads it
+JointChannel jointChannel;
+///True if this move node sends on the shared memory channel, the channel has a single name for the root namespace
+bool useJointChannel = false;
+///Joint command being sent, preallocated and filled in place at every cycle
+cpp_publisher::JointCommand jointCommand;
+///Joint command in the layout of the controller topic, resized only when the number of values changes
+std_msgs::Float64MultiArray legacyJointCommand;
+///Subscriber for the move orders of the planner
+ros::Subscriber coordinateSubscriber;
+///Log of the move orders received, open only if the session_log parameter is set
+SessionLog sessionLog;
 ///Client for the service call to move the gripper
 ros::ServiceClient gripperClient;
 ///Current joint state of the robot
 MatrixXf currentJoint(1,6);
 ///Current joint state of the gripper
 MatrixXf currentGripper;
+///Velocity of the approach movements [m/s]
+float approachVelocity = APPROACH_VELOCITY;
+///World frame offset of the base of this arm from the base of the single arm cell, read from the base_offset parameter
+Vector3f baseOffset = Vector3f::Zero();
+///Reservations of the workspace shared with the move nodes of the other arms
+WorkspaceReservations reservations;
+///One shot timer bringing the arm to its waiting position when no order follows the last one
+ros::Timer parkTimer;
 
 //=======FUNCTION DECLARATION=======
+void setupMove(ros::NodeHandle node); //advertise and subscribe the move node topics
 Vector3f xe(float t, Vector3f xef, Vector3f xe0, const float& movementTime); //linear interpolation of the position
 MatrixXf toRotationMatrix(Vector3f euler); //convert euler angles to rotation matrix
 void computeMovementDifferential(Vector3f targetPosition, Vector3f targetOrientation,float dt,const bool& approach);//compute the movement
@@ -72,34 +139,100 @@ MatrixXf invDiffKinematiControlComplete(MatrixXf q, MatrixXf xe, MatrixXf xd, Ma
 MatrixXf computeOrientationError(MatrixXf wRe, MatrixXf wRd);//compute orientation error
 MatrixXf jacobian(MatrixXf Th);//compute jacobian
 
-void coordinateCallback(const cpp_publisher::Coordinates::ConstPtr& coordinateMessage);//callback for the coordinates
+void coordinateCallback(const cpp_publisher::CoordinatesV2::ConstPtr& coordinateMessage);//callback for the coordinates
 void publishJoint(MatrixXf publishPos); //publish the joint angles
-void publishMoveOperation(int blockId, bool success); //publish the ack to planner
+void sendJointCommand(); //send the current joint command on the channel or on a topic
+void publishMoveOperation(uint64_t blockId, uint64_t traceId, bool success); //publish the ack to planner
+void publishMoveProgress(uint64_t blockId, uint64_t traceId, string stage); //publish the stage reached to planner
+void publishLegacy(const ros::Publisher& pub, const cpp_publisher::MoveOperationV2& msg); //publish a copy in the original message
 void changeSoftGripper(float firstVal, float secondVal); //change the soft gripper
 void changeHardGripper(float diameter); //change the hard gripper
 Vector3f mapToGripperJoints(float diameter); //map the diameter to the gripper joints
 
-void moveObject(Vector3f pos, Vector3f ori, Vector3f targetPos); //move the object
+void moveObject(Vector3f pos, Vector3f ori, Vector3f targetPos, float targetYaw, uint64_t blockId, uint64_t traceId, float graspVelocity); //move the object
+void parkCallback(const ros::TimerEvent& event); //move to the waiting position if no order arrived
+bool reserveCorridor(const cpp_publisher::CoordinatesV2& order); //reserve the workspace swept by an order
+bool holdPosition(); //reserve the workspace around the arm while it waits
+float graspApproachVelocity(const boost::array<double, 9>& covariance); //choose the approach velocity from the block position covariance
 void moveDown(float distance); //move down of distance
 void moveUp(float distance); //move up of distance
 
 void generateManualControlMenu(); //generate the manual control menu
 
 //=======MAIN FUNCTION=======
+#ifndef MOVE_NODELET
 int main(int argc, char **argv){
 
     //ROS initialization
     ros::init(argc, argv, "move");
     ros::NodeHandle node;
 
-    pub_des_jstate = node.advertise<std_msgs::Float64MultiArray>("/ur5/joint_group_pos_controller/command", 1); //publisher for desired joint state
+    setupMove(node);
 
-    pub_move_operation = node.advertise<cpp_publisher::MoveOperation>("/move/movement_results", 1); //publisher for desired joint state
+    //ros::spin() in order to wait for the planner to send the coordinates
+    if(!MANUAL_CONTROL){
+        ros::spin();
+    }
+
+    //manual control of the robot with a menu
+    if(MANUAL_CONTROL){
+        generateManualControlMenu();
+    }
+
+    return 0;
+}
+#endif
+
+//=======FUNCTION DEFINITION=======
+
+/**
+ * @brief Advertise the move node topics, subscribe to the planner and bring the robot and the gripper to their initial state.
+ * Shared by the standalone executable and the nodelet
+ * 
+ * @param node 
+ */
+void setupMove(ros::NodeHandle node){
+
+    //The topics are relative, so that every arm of a cell runs its move node in its own namespace
+    pub_des_jstate = node.advertise<std_msgs::Float64MultiArray>("ur5/joint_group_pos_controller/command", 1); //publisher for desired joint state
+
+    pub_joint_command = node.advertise<cpp_publisher::JointCommand>("move/joint_command", 1); //publisher for the compact joint commands
+
+    //The V2 messages have their own topics, the original topics keep their message type for the tools still using them
+    pub_move_operation = node.advertise<cpp_publisher::MoveOperationV2>("move/movement_results_v2", 1); //publisher for the result of the movement
+
+    pub_move_progress = node.advertise<cpp_publisher::MoveOperationV2>("move/movement_progress_v2", 1); //publisher for the stage reached by the movement
+
+    pub_legacy_operation = node.advertise<cpp_publisher::MoveOperation>("move/movement_results", 1); //publisher for the result in the original message
+
+    pub_legacy_progress = node.advertise<cpp_publisher::MoveOperation>("move/movement_progress", 1); //publisher for the stage in the original message
+
+    coordinateSubscriber = node.subscribe("planner/position_v2", 1, coordinateCallback); //subscriber for block position
 
-    ros::Subscriber coordinateSubscriber = node.subscribe("/planner/position", 1, coordinateCallback); //subscriber for block position
+    parkTimer = node.createTimer(ros::Duration(PARK_DELAY), parkCallback, true, false);
+
+    vector<double> offset;
+    node.param<vector<double>>("base_offset", offset, vector<double>(2, 0.0));
+    if(offset.size() >= 2)
+        baseOffset << offset[0], offset[1], 0;
 
     gripperClient = node.serviceClient<ros_impedance_controller::generic_float>("move_gripper");
 
+    string logFile;
+    ros::NodeHandle("~").param<string>("session_log", logFile, "");
+    if(!logFile.empty())
+        sessionLog.open(logFile);
+
+    if(RESERVE_WORKSPACE && !reservations.open(node.getNamespace()))
+        cout << "Reservation table not available, moving without reserving the workspace" << endl;
+
+    //The shared memory channel has a single name, only the move node of the root namespace uses it
+    useJointChannel = JOINT_CHANNEL && node.getNamespace() == "/";
+    if(useJointChannel){
+        if(jointChannel.connect()) cout << "Sending the joint commands on the shared memory channel" << endl;
+        else cout << "Joint bridge not running, sending the joint commands on the topic" << endl;
+    }
+
     MatrixXf customHomingJoint(1,6);
     customHomingJoint <<   -2.7907,-0.78, -2.56,-1.63, -1.57, 3.49; //custom homing procedure joint angles
 
@@ -112,24 +245,8 @@ int main(int argc, char **argv){
 
     float initialGripperDiameter = 130.0;
     changeHardGripper(initialGripperDiameter);
-
-    //ros::spin() in order to wait for the planner to send the coordinates
-    if(!MANUAL_CONTROL){
-        while(ros::ok()){
-            ros::spinOnce();
-        }
-    }
-
-    //manual control of the robot with a menu
-    if(MANUAL_CONTROL){
-        generateManualControlMenu();
-    }
-
-    return 0;
 }
 
-//=======FUNCTION DEFINITION=======
-
 /**
  * @brief Generate a human readable menu for manual control of the robot with differential commands
  * 
@@ -164,7 +281,7 @@ void generateManualControlMenu(){
 
             if(refFrame == 0) {
                 pos(2) += 0.01;
-                pos = transformationWorldToBase(pos);
+                pos = transformationWorldToBase(pos - baseOffset);
             }
 
             computeMovementDifferential(pos, ori ,0.001,false); //compute the movement to the first brick in tavolo_brick.world
@@ -227,7 +344,7 @@ void computeMovementDifferential(Vector3f targetPosition, Vector3f targetOrienta
     positionDifference = targetPosition - x0;
     float distance = positionDifference.norm();
     float movementTime;
-    if(approach) movementTime = distance / APPROACH_VELOCITY;
+    if(approach) movementTime = distance / approachVelocity;
     else movementTime = distance / MOVEMENT_VELOCITY;
 
     MatrixXf kp(3,3);
@@ -446,58 +563,114 @@ MatrixXf toRotationMatrix(Vector3f euler){
  */
 void publishJoint(MatrixXf publishPos){
 
-    std_msgs::Float64MultiArray msg;
     ros::Rate loop_rate(LOOPRATE);
 
+    for (int i = 0; i < ROBOT_JOINTS; i++){
+        jointCommand.joints[i] = publishPos(0, i);
+    }
+
     if(HARD_GRIPPER && !REAL_ROBOT){
-        msg.data.resize(ROBOT_JOINTS+EE_HARD_JOINTS); //6 joint angles + 3 hard gripper angles
-        msg.data.assign(ROBOT_JOINTS+EE_HARD_JOINTS,0); //empty the msg
-        
-        for (int i = 0; i < ROBOT_JOINTS; i++){
-            msg.data[i] = publishPos(0, i);
-        }
+        //6 joint angles + 3 hard gripper angles
         for(int i=0; i<EE_HARD_JOINTS; i++){
-            msg.data[i+ROBOT_JOINTS] = currentGripper(i);
-        }
-
-    }else if(REAL_ROBOT && HARD_GRIPPER){
-        msg.data.resize(ROBOT_JOINTS); //6 joint angles
-        msg.data.assign(ROBOT_JOINTS,0); //empty the msg
-
-        for (int i = 0; i < ROBOT_JOINTS; i++){
-            msg.data[i] = publishPos(0, i);
+            jointCommand.gripper[i] = currentGripper(i);
         }
+        jointCommand.gripperJoints = EE_HARD_JOINTS;
+    }else{
+        jointCommand.gripperJoints = 0; //6 joint angles, the gripper of the real robot has its own service
     }
 
-    pub_des_jstate.publish(msg); // publish the message
+    sendJointCommand(); // publish the message
 
     loop_rate.sleep(); // sleep for the time remaining to let us hit our 1000Hz publish rate
 }
 
+/**
+ * @brief Send the current joint command to the controller: on the shared memory channel if the joint bridge is reading it,
+ * with the compact message if the joint bridge subscribes to it, on the topic of the controller otherwise.
+ * The compact message has a fixed layout, so it is filled in place without allocations
+ * 
+ */
+void sendJointCommand(){
+
+    int count = ROBOT_JOINTS + jointCommand.gripperJoints;
+    jointCommand.stamp = ros::Time::now();
+
+    if(jointChannel.readerAlive()){
+        double values[ROBOT_JOINTS + EE_HARD_JOINTS];
+        copy(jointCommand.joints.begin(), jointCommand.joints.end(), values);
+        copy(jointCommand.gripper.begin(), jointCommand.gripper.begin() + jointCommand.gripperJoints, values + ROBOT_JOINTS);
+        jointChannel.write(values, count);
+    }else if(COMPACT_JOINT_COMMAND && pub_joint_command.getNumSubscribers() > 0){
+        pub_joint_command.publish(jointCommand);
+    }else{
+        if(legacyJointCommand.data.size() != count) legacyJointCommand.data.resize(count);
+        copy(jointCommand.joints.begin(), jointCommand.joints.end(), legacyJointCommand.data.begin());
+        copy(jointCommand.gripper.begin(), jointCommand.gripper.begin() + jointCommand.gripperJoints, legacyJointCommand.data.begin() + ROBOT_JOINTS);
+        pub_des_jstate.publish(legacyJointCommand);
+    }
+}
+
 /**
  * @brief Send an ack to the planner in order to communicate the correct execution of the move operation
  * 
  * @param blockId 
+ * @param traceId trace of the move order, echoed back to the planner
  * @param success 
  */
-void publishMoveOperation(int blockId, bool success){
+void publishMoveOperation(uint64_t blockId, uint64_t traceId, bool success){
 
-    cpp_publisher::MoveOperation msg;
-    std_msgs::Byte byteMsg;
-    std_msgs::String stringMsg;
+    //Published as a shared pointer, a planner in the same process receives it without serialisation
+    cpp_publisher::MoveOperationV2Ptr msg(new cpp_publisher::MoveOperationV2);
 
-    byteMsg.data = blockId;
+    msg->header.stamp = ros::Time::now();
+    msg->blockId = blockId;
+    msg->traceId = traceId;
 
     if(success){
-        stringMsg.data = "success";
+        msg->result = "success";
     }else{
-        stringMsg.data = "fail - Something went wrong";
+        msg->result = "fail - Something went wrong";
     }
 
-    msg.blockId = byteMsg;
-    msg.result = stringMsg;
-
     pub_move_operation.publish(msg);
+    publishLegacy(pub_legacy_operation, *msg);
+}
+
+/**
+ * @brief Notify the planner of the stage reached by the move operation, so that it can overlap its work with the movement
+ * 
+ * @param blockId 
+ * @param traceId 
+ * @param stage 
+ */
+void publishMoveProgress(uint64_t blockId, uint64_t traceId, string stage){
+
+    cpp_publisher::MoveOperationV2Ptr msg(new cpp_publisher::MoveOperationV2);
+
+    msg->header.stamp = ros::Time::now();
+    msg->blockId = blockId;
+    msg->traceId = traceId;
+    msg->result = stage;
+
+    pub_move_progress.publish(msg);
+    publishLegacy(pub_legacy_progress, *msg);
+}
+
+/**
+ * @brief Publish a copy of a result or progress in the original message, only if a tool subscribes to it
+ * 
+ * @param pub publisher of the original topic
+ * @param msg 
+ */
+void publishLegacy(const ros::Publisher& pub, const cpp_publisher::MoveOperationV2& msg){
+
+    if(pub.getNumSubscribers() == 0)
+        return;
+
+    cpp_publisher::MoveOperation legacyMsg;
+    legacyMsg.blockId.data = msg.blockId; //the original block id is a single byte
+    legacyMsg.result.data = msg.result;
+    pub.publish(legacyMsg);
 }
 
 /**
@@ -535,20 +708,18 @@ void changeHardGripper(float diameter){
 
         Vector3f ee_joints = mapToGripperJoints(diameter);
 
-        std_msgs::Float64MultiArray msg;
-        msg.data.resize(ROBOT_JOINTS+EE_HARD_JOINTS); //6 joint angles + 3 end effector joints
-        msg.data.assign(ROBOT_JOINTS+EE_HARD_JOINTS,0); //empty the msg
-
+        //6 joint angles + 3 end effector joints
         for(int i = 0; i < ROBOT_JOINTS; i++)
-            msg.data[i] = currentJoint(0,i);
+            jointCommand.joints[i] = currentJoint(0,i);
 
-        msg.data[ROBOT_JOINTS+0] = ee_joints(0);
-        msg.data[ROBOT_JOINTS+1] = ee_joints(1);
-        msg.data[ROBOT_JOINTS+2] = ee_joints(2);
+        jointCommand.gripper[0] = ee_joints(0);
+        jointCommand.gripper[1] = ee_joints(1);
+        jointCommand.gripper[2] = ee_joints(2);
+        jointCommand.gripperJoints = EE_HARD_JOINTS;
 
         currentGripper = ee_joints;
 
-        pub_des_jstate.publish(msg); //to do -> change publisher with new topic
+        sendJointCommand();
     }else{
         ros_impedance_controller::generic_float srv;
         srv.request.data = diameter;
@@ -595,47 +766,201 @@ Vector3f xe(float t, Vector3f xef, Vector3f xe0, const float& movementTime){
  * 
  * @param coordinateMessage 
  */
-void coordinateCallback(const cpp_publisher::Coordinates::ConstPtr& coordinateMessage){
+void coordinateCallback(const cpp_publisher::CoordinatesV2::ConstPtr& coordinateMessage){
+
+    sessionLog.record(LOG_MOVE_ORDER, *coordinateMessage, ros::Time::now().toSec());
+
+    //The next order starts from where the last one ended
+    parkTimer.stop();
+
+    //The joint bridge started or restarted since the last order: its new slot replaces the old one, whose heartbeat stopped
+    if(useJointChannel && !jointChannel.readerAlive() && jointChannel.connect())
+        cout << "Sending the joint commands on the shared memory channel" << endl;
 
     cout << "Received coordinates" << endl;
 
-    cout << "Moving block " << coordinateMessage->blockId.data << endl;
+    //The stamp is set by the planner when it sends the order, the difference is the transport latency
+    cout << "Moving block " << coordinateMessage->blockId << " (trace " << hex << coordinateMessage->traceId << dec << "), order received after "
+         << (ros::Time::now() - coordinateMessage->header.stamp).toSec() * 1000 << " ms" << endl;
 
     Vector3f pos,target;
     pos << coordinateMessage->from.x, coordinateMessage->from.y, coordinateMessage->from.z;
     target << coordinateMessage->to.x, coordinateMessage->to.y, coordinateMessage->to.z;
 
+    //The gripper closes on the short side of the block, the transport is done with the gripper back to zero
     Vector3f ori = Vector3f::Zero();
+    ori(0) = yawWorldToBase(coordinateMessage->fromYaw);
 
     //Adding 0.01 to the z coordinate to avoid collision with the table
     pos(2) = 0.92;
-    target(2) = 0.92;
+    target(2) = 0.92 + max(0.0, coordinateMessage->to.z - TABLE_PLACE_HEIGHT); //blocks stacked on other blocks are released higher
 
     cout << "Moving object from " << pos.transpose() << " to " << target.transpose() << endl;
 
-    pos = transformationWorldToBase(pos);
-    target = transformationWorldToBase(target);
+    //The reservation is kept after the order, the arm waits above the target until the next order or the park move
+    if(RESERVE_WORKSPACE && reservations.connected() && !reserveCorridor(*coordinateMessage)){
+        //The planner puts the block back on the table, it will be detected again and assigned to the arm completing it first
+        cout << "Workspace held by another arm, giving the order back to the planner" << endl;
+        publishMoveOperation(coordinateMessage->blockId, coordinateMessage->traceId, false);
+        parkTimer.start();
+        return;
+    }
+
+    pos = transformationWorldToBase(pos - baseOffset);
+    target = transformationWorldToBase(target - baseOffset);
 
-    moveObject(pos, ori, target);
+    moveObject(pos, ori, target, yawWorldToBase(coordinateMessage->toYaw), coordinateMessage->blockId, coordinateMessage->traceId, graspApproachVelocity(coordinateMessage->fromCovariance));
 
     cout << "Sending success message" << endl;
-    publishMoveOperation(coordinateMessage->blockId.data, true);
+    publishMoveOperation(coordinateMessage->blockId, coordinateMessage->traceId, true);
+
+    parkTimer.setPeriod(ros::Duration(PARK_DELAY));
+    parkTimer.start();
+}
+
+/**
+ * @brief Move the arm from the target area to its waiting position, called when no order followed the last one.
+ * If the corridor is held by another arm the arm stays where it is and tries again later
+ * 
+ * @param event 
+ */
+void parkCallback(const ros::TimerEvent& event){
+
+    //Same waiting position of homePosition() in pickOrder.cpp
+    EEPose eePose = fwKin(currentJoint);
+    Vector3f rest = transformationWorldToBase(Vector3f(0.2, 0.8, 1.1));
+    Vector3f parked = rest;
+    parked(2) -= 0.2;
+    if((eePose.Pe - parked).norm() < 0.01) return;
+
+    bool reserved = RESERVE_WORKSPACE && reservations.connected();
+    if(reserved){
+        Vector3f base = transformationBaseToWorld(Vector3f::Zero()) + baseOffset;
+        Vector3f current = transformationBaseToWorld(eePose.Pe) + baseOffset;
+        double start = WorkspaceReservations::now(), end = start + PARK_RESERVATION_TIME;
+        vector<CellWindow> windows = reservations.corridor(base, {current, Vector3f(0.2, 0.8, 1.1) + baseOffset}, {start, start}, {end, end}, CORRIDOR_RADIUS);
+        double blockedUntil = reservations.conflictEnd(windows);
+        if(blockedUntil != 0 || !reservations.reserve(windows, blockedUntil)){
+            //The arm stays above the target, its reservation is renewed while it waits
+            holdPosition();
+            parkTimer.setPeriod(ros::Duration(PARK_DELAY));
+            parkTimer.start();
+            return;
+        }
+    }
+
+    // Moving back in the left of the table
+    cout << "No orders, moving to the waiting position" << endl;
+    computeMovementDifferential(rest, Vector3f::Zero(), 0.001,false);
+    moveUp(0.2);
+
+    if(reserved)
+        reservations.release();
+}
+/**
+ * @brief Reserve the cells swept by the arm along the waypoints of an order, from its current position to the end of the
+ * order above the target. Every segment is reserved from the time it is reached to the latest time it is left, the end of
+ * the order until the next reservation replaces it. While another arm holds some of the cells the order waits, the
+ * corridor is checked without locking the table
+ * 
+ * @param order
+ * @return true if the corridor is reserved, false if it is still held after RESERVATION_WAIT
+ */
+bool reserveCorridor(const cpp_publisher::CoordinatesV2& order){
+
+    Vector3f base = transformationBaseToWorld(Vector3f::Zero()) + baseOffset;
+    Vector3f from(order.from.x, order.from.y, order.from.z), to(order.to.x, order.to.y, order.to.z);
+    vector<Waypoint> waypoints = pickWaypoints(fwKin(currentJoint).Pe, from - baseOffset, to - baseOffset);
+
+    //The arm waits at the end of the order
+    vector<Vector3f> points;
+    for(int i = 0; i < waypoints.size(); i++)
+        points.push_back(transformationBaseToWorld(waypoints[i].position) + baseOffset);
+    points.push_back(points.back());
+
+    double waitStart = WorkspaceReservations::now();
+    bool waiting = false;
+
+    while(true){
+        double start = WorkspaceReservations::now();
+        vector<double> earliest, latest;
+        for(int i = 0; i < waypoints.size(); i++){
+            earliest.push_back(start + waypoints[i].time);
+            latest.push_back(start + waypoints[i].time * RESERVATION_SLACK + RESERVATION_MARGIN);
+        }
+        earliest.push_back(latest.back());
+        latest.push_back(latest.back() + END_RESERVATION_TIME);
+
+        vector<CellWindow> windows = reservations.corridor(base, points, earliest, latest, CORRIDOR_RADIUS);
+        double blockedUntil = reservations.conflictEnd(windows);
+
+        if(blockedUntil == 0 && reservations.reserve(windows, blockedUntil)){
+            if(waiting) cout << "Corridor free after " << start - waitStart << " s" << endl;
+            return true;
+        }
 
+        if(start - waitStart > RESERVATION_WAIT)
+            return false;
 
+        if(!waiting){
+            cout << "Corridor of " << windows.size() << " cells held by another arm, waiting" << endl;
+            publishMoveProgress(order.blockId, order.traceId, "waiting for workspace");
+            waiting = true;
+        }
+        //The other arm usually releases its corridor before the end of its reservation
+        usleep(RESERVATION_POLL);
+    }
 }
+
+/**
+ * @brief Renew the reservation of the cells around the arm while it waits where it is, replacing its other windows
+ * 
+ * @return true if the cells are reserved
+ */
+bool holdPosition(){
+
+    Vector3f base = transformationBaseToWorld(Vector3f::Zero()) + baseOffset;
+    Vector3f current = transformationBaseToWorld(fwKin(currentJoint).Pe) + baseOffset;
+    double start = WorkspaceReservations::now(), end = start + END_RESERVATION_TIME;
+    vector<CellWindow> windows = reservations.corridor(base, {current, current}, {start, start}, {end, end}, CORRIDOR_RADIUS);
+
+    double blockedUntil;
+    return reservations.conflictEnd(windows) == 0 && reservations.reserve(windows, blockedUntil);
+}
+
+/**
+ * @brief Choose the velocity of the approach to the block: fast if the planner knows the block position precisely, slow otherwise
+ * 
+ * @param covariance row major world frame covariance of the block position, zero if unknown
+ * @return float 
+ */
+float graspApproachVelocity(const boost::array<double, 9>& covariance){
+    float sigma = sqrt(max(covariance[0], covariance[4]));
+    if(sigma > 0 && sigma < FAST_APPROACH_SIGMA){
+        cout << "Block position known within " << sigma << " m, fast approach" << endl;
+        return FAST_APPROACH_VELOCITY;
+    }
+    return APPROACH_VELOCITY;
+}
+
 /**
  * @brief Compute the movement routine to move the object from its position to its target position
  * 
  * @param pos 
  * @param ori 
  * @param targetPos 
+ * @param targetYaw base frame yaw of the gripper at the release, the block is turned with it
+ * @param blockId 
+ * @param traceId trace of the move order, attached to the progress messages
+ * @param graspVelocity velocity of the approach to the block
  */
-void moveObject(Vector3f pos, Vector3f ori, Vector3f targetPos){
+void moveObject(Vector3f pos, Vector3f ori, Vector3f targetPos, float targetYaw, uint64_t blockId, uint64_t traceId, float graspVelocity){
 
     EEPose eePose;
 
     // Kinematics
     cout << "Starting kinematics" << endl;
+    publishMoveProgress(blockId, traceId, "started");
 
     //Moving above the block
     cout << "Moving above the block" << endl;
@@ -646,7 +971,9 @@ void moveObject(Vector3f pos, Vector3f ori, Vector3f targetPos){
 
     //moving in z
     cout << "Moving in z" << endl;
+    approachVelocity = graspVelocity;
     computeMovementDifferential(pos, ori, 0.001,true);
+    approachVelocity = APPROACH_VELOCITY;
     if(DEBUG)sleep(2);
 
     // Grasping
@@ -658,6 +985,7 @@ void moveObject(Vector3f pos, Vector3f ori, Vector3f targetPos){
     }
     changeHardGripper(diameter);
     sleep(2);
+    publishMoveProgress(blockId, traceId, "grasped");
 
     //moving in z
     cout << "Moving in z" << endl;
@@ -671,6 +999,7 @@ void moveObject(Vector3f pos, Vector3f ori, Vector3f targetPos){
     tmp(1) = -0.4;
     tmp(2) = 0.5;
     computeMovementDifferential(tmp, Vector3f::Zero(), 0.001,false);
+    publishMoveProgress(blockId, traceId, "left check point"); //the arm is out of the camera view
     if(DEBUG)sleep(2);
 
     //moving to the right check point to stay safe
@@ -681,22 +1010,25 @@ void moveObject(Vector3f pos, Vector3f ori, Vector3f targetPos){
     computeMovementDifferential(tmp, Vector3f::Zero(), 0.001,false);
     if(DEBUG)sleep(2);
 
-    //moving in x,y
+    //moving in x,y, the gripper turns the block to its yaw in the target area
+    Vector3f releaseOri = Vector3f::Zero();
+    releaseOri(0) = targetYaw;
     tmp = targetPos;
     eePose = fwKin(currentJoint);
     tmp(2) = eePose.Pe(2);
-    computeMovementDifferential(tmp, Vector3f::Zero(), 0.001,false);
+    computeMovementDifferential(tmp, releaseOri, 0.001,false);
     if(DEBUG)sleep(2);
 
     // Moving to target in z
     cout << "Moving to target" << endl;
-    computeMovementDifferential(targetPos, Vector3f::Zero(), 0.001,true);
+    computeMovementDifferential(targetPos, releaseOri, 0.001,true);
     if(DEBUG)sleep(2);
 
     // Releasing
     cout << "Releasing object" << endl;
     changeHardGripper(100);
     sleep(2);
+    publishMoveProgress(blockId, traceId, "placed");
 
     // Moving up
     cout << "Moving up" << endl;
@@ -712,13 +1044,7 @@ void moveObject(Vector3f pos, Vector3f ori, Vector3f targetPos){
     }
     if(DEBUG)sleep(2);
 
-    // Moving back in the left of the table
-    tmp = Vector3f(0.2, 0.8, 1.1);
-    tmp = transformationWorldToBase(tmp);
-    computeMovementDifferential(tmp, Vector3f::Zero(), 0.001,false);
-    moveUp(0.2);
-    if(DEBUG)sleep(2);
-    
+    //The next order starts from here, parkCallback() goes back in the left of the table if none arrives
 }
 
 /**
@@ -0,0 +1,40 @@
+/**
+ * @file moveNodelet.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the move node packaged as a nodelet
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Loaded in the same nodelet manager as the planner, the move orders and the move results are passed as shared
+ * pointers without serialisation. The move source is included without its main function, the manual control menu
+ * is available only in the standalone executable.
+ */
+
+#define MOVE_NODELET
+#include "move.cpp"
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+namespace cpp_publisher{
+
+/**
+ * @brief Nodelet running the move node
+ *
+ */
+class MoveNodelet : public nodelet::Nodelet{
+private:
+    /**
+     * @brief Set up the move node, a move order blocks one thread of the nodelet manager until the movement is over
+     *
+     */
+    virtual void onInit(){
+        setupMove(getNodeHandle());
+    }
+};
+
+}
+
+PLUGINLIB_EXPORT_CLASS(cpp_publisher::MoveNodelet, nodelet::Nodelet)
@@ -0,0 +1,323 @@
+/**
+ * @file pickOrder.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the cycle time model of the move node and the optimiser of the order in which the blocks are picked
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The cycle time of a block is estimated replaying the waypoints of moveObject() in the base frame: computeMovementDifferential()
+ * follows a straight line at constant velocity, so each segment lasts its length divided by the movement or approach velocity.
+ * After releasing a block the move node waits above the target and goes back to its waiting position only if no other
+ * order arrives, so a cycle starts where the previous one ended and the order of the picks changes the total time.
+ * Needs frame2frame.cpp to be included before this file.
+ */
+
+#include <iostream>
+#include <Eigen/Dense>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+using Eigen::Vector3f;
+
+#ifndef MOVEMENT_VELOCITY
+///Velocity of the movement while not approaching the block [m/s]
+#define MOVEMENT_VELOCITY 0.3
+#endif
+#ifndef APPROACH_VELOCITY
+///Velocity while approaching the block [m/s]
+#define APPROACH_VELOCITY 0.1
+#endif
+///Time spent by the move node to close or open the gripper [s]
+#define GRIPPER_TIME 2.0
+///Height in the world frame of the grasp and release points used by the move node
+#define GRASP_HEIGHT 0.92
+///Height of the placements on the table sent by the planner, higher placements are on top of other blocks
+#define TABLE_PLACE_HEIGHT 0.9
+///Time budget of a single order optimisation [ms]
+#define ORDER_SOLVE_BUDGET 5.0
+
+///Orders evaluated by an optimisation instead of its time budget, 0 to use the time budget. Set by the session replay,
+///whose results must not depend on the speed of the machine
+int orderSolveEvaluations = 0;
+
+/**
+ * @brief Struct to store the estimated time of a pick and place cycle and the position of the end effector at its end
+ *
+ */
+struct PickCycle{
+    float time;
+    Vector3f endPos;
+};
+
+/**
+ * @brief Struct to store a point reached by the end effector during a cycle and when it is reached
+ *
+ */
+struct Waypoint{
+    Vector3f position; // base frame
+    float time; // from the start of the cycle [s]
+};
+
+Vector3f homePosition(); // Base frame position where the move node parks when it has no orders
+float segmentTime(Vector3f from, Vector3f to, bool approach); // Time of a straight line movement
+Vector3f cycleEnd(Vector3f targetPos); // Base frame position where the cycle of a block placed in a target ends
+vector<Waypoint> pickWaypoints(Vector3f startPos, Vector3f blockPos, Vector3f targetPos); // Points reached by the pick and place of one block
+PickCycle estimatePickCycle(Vector3f startPos, Vector3f blockPos, Vector3f targetPos); // Time of the pick and place of one block
+float sequenceTime(const vector<Vector3f>& blockPos, const vector<Vector3f>& targetPos, const vector<int>& order, Vector3f startPos); // Time of a whole pick order
+vector<int> optimisePickOrder(const vector<Vector3f>& blockPos, const vector<Vector3f>& targetPos, vector<int> order, Vector3f startPos, float budget); // Optimise the pick order
+
+/**
+ * @brief Base frame position where the move node parks when no order arrives after moveObject()
+ *
+ * @return Vector3f
+ */
+Vector3f homePosition(){
+    Vector3f home = transformationWorldToBase(Vector3f(0.2, 0.8, 1.1));
+    home(2) -= 0.2;
+    return home;
+}
+
+/**
+ * @brief Time needed by computeMovementDifferential() to move on a straight line between two points
+ *
+ * @param from
+ * @param to
+ * @param approach
+ * @return float
+ */
+float segmentTime(Vector3f from, Vector3f to, bool approach){
+    float distance = (to - from).norm();
+    if(approach) return distance / APPROACH_VELOCITY;
+    return distance / MOVEMENT_VELOCITY;
+}
+
+/**
+ * @brief Base frame position where the move node waits for the next order after releasing a block: above the target and
+ * out of the target area
+ *
+ * @param targetPos world frame position where the block is placed
+ * @return Vector3f
+ */
+Vector3f cycleEnd(Vector3f targetPos){
+    targetPos(2) = GRASP_HEIGHT + max(0.0f, targetPos(2) - (float)TABLE_PLACE_HEIGHT);
+    Vector3f end = transformationWorldToBase(targetPos);
+    end(2) -= 0.2;
+    end(1) = min(end(1), -0.4f);
+    return end;
+}
+
+/**
+ * @brief Points reached by moveObject() during the pick and place of a block, starting from a given end effector position.
+ * The gripper is closed and opened without moving, so the grasp and release points appear twice
+ *
+ * @param startPos base frame position of the end effector
+ * @param blockPos world frame position of the block
+ * @param targetPos world frame position where the block is placed
+ * @return vector<Waypoint> from the start position to the end of the cycle
+ */
+vector<Waypoint> pickWaypoints(Vector3f startPos, Vector3f blockPos, Vector3f targetPos){
+
+    blockPos(2) = GRASP_HEIGHT;
+    targetPos(2) = GRASP_HEIGHT + max(0.0f, targetPos(2) - (float)TABLE_PLACE_HEIGHT);
+    Vector3f pos = transformationWorldToBase(blockPos);
+    Vector3f target = transformationWorldToBase(targetPos);
+
+    vector<Waypoint> waypoints = {{startPos, 0}};
+    auto moveTo = [&](Vector3f next, bool approach){
+        waypoints.push_back({next, waypoints.back().time + segmentTime(waypoints.back().position, next, approach)});
+    };
+    auto wait = [&](float time){
+        waypoints.push_back({waypoints.back().position, waypoints.back().time + time});
+    };
+    Vector3f next;
+
+    //Above the block and down to grasp it
+    next = pos;
+    next(2) -= 0.2;
+    moveTo(next, false);
+    moveTo(pos, true);
+    wait(GRIPPER_TIME);
+
+    //Up and through the check points
+    next = pos;
+    next(2) -= 0.1;
+    moveTo(next, true);
+    moveTo(Vector3f(-0.4, -0.4, 0.5), false);
+    moveTo(Vector3f(0.4, -0.4, 0.5), false);
+
+    //Above the target and down to release the block
+    next = target;
+    next(2) = 0.5;
+    moveTo(next, false);
+    moveTo(target, true);
+    wait(GRIPPER_TIME);
+
+    //Up and out of the target area, where the next order starts
+    next = target;
+    next(2) -= 0.2;
+    moveTo(next, true);
+    moveTo(cycleEnd(targetPos), false);
+
+    return waypoints;
+}
+
+/**
+ * @brief Estimate the time of the pick and place cycle of moveObject(), starting from a given end effector position
+ *
+ * @param startPos base frame position of the end effector
+ * @param blockPos world frame position of the block
+ * @param targetPos world frame position where the block is placed
+ * @return PickCycle
+ */
+PickCycle estimatePickCycle(Vector3f startPos, Vector3f blockPos, Vector3f targetPos){
+
+    vector<Waypoint> waypoints = pickWaypoints(startPos, blockPos, targetPos);
+
+    PickCycle cycle;
+    cycle.time = waypoints.back().time;
+    cycle.endPos = waypoints.back().position;
+    return cycle;
+}
+
+/**
+ * @brief Estimate the time needed to move all the blocks following the given order
+ *
+ * @param blockPos world frame position of each block
+ * @param targetPos world frame target position of each block
+ * @param order indexes of the blocks in the order they are picked
+ * @param startPos base frame position of the end effector before the first pick
+ * @return float
+ */
+float sequenceTime(const vector<Vector3f>& blockPos, const vector<Vector3f>& targetPos, const vector<int>& order, Vector3f startPos){
+
+    float time = 0;
+    Vector3f current = startPos;
+
+    for(int i = 0; i < order.size(); i++){
+        PickCycle cycle = estimatePickCycle(current, blockPos[order[i]], targetPos[order[i]]);
+        time += cycle.time;
+        current = cycle.endPos;
+    }
+
+    return time;
+}
+
+/**
+ * @brief Optimise the order in which the blocks are picked to minimise the total cycle time.
+ * The blocks already in the order keep their relative position, the missing ones are inserted where they cost less
+ * (nearest neighbour when the order is empty), then the order is improved with 2-opt and Or-opt moves until no move
+ * improves it, so the function can be called again every time new blocks are detected.
+ * When the time budget is over the blocks not placed yet are appended and the order is returned as it is. With
+ * orderSolveEvaluations set the budget is a number of orders evaluated, and the result depends only on the inputs
+ *
+ * @param blockPos world frame position of each block
+ * @param targetPos world frame target position of each block
+ * @param order current order, may contain only part of the blocks
+ * @param startPos base frame position of the end effector before the first pick
+ * @param budget time budget [ms]
+ * @return vector<int>
+ */
+vector<int> optimisePickOrder(const vector<Vector3f>& blockPos, const vector<Vector3f>& targetPos, vector<int> order, Vector3f startPos, float budget){
+
+    auto start = chrono::steady_clock::now();
+    int evaluations = 0;
+    auto outOfTime = [&](){
+        if(orderSolveEvaluations > 0) return evaluations >= orderSolveEvaluations;
+        return chrono::duration<float, milli>(chrono::steady_clock::now() - start).count() > budget;
+    };
+    auto evaluate = [&](const vector<int>& candidate){
+        evaluations++;
+        return sequenceTime(blockPos, targetPos, candidate, startPos);
+    };
+
+    int n = blockPos.size();
+    vector<bool> ordered(n, false);
+    for(int i = 0; i < order.size(); i++) ordered[order[i]] = true;
+
+    //Nearest neighbour construction when there is no order yet
+    if(order.empty()){
+        Vector3f current = startPos;
+        for(int k = 0; k < n && !outOfTime(); k++){
+            int best = -1;
+            PickCycle bestCycle;
+            for(int i = 0; i < n; i++){
+                if(ordered[i]) continue;
+                PickCycle cycle = estimatePickCycle(current, blockPos[i], targetPos[i]);
+                evaluations++;
+                if(best < 0 || cycle.time < bestCycle.time){
+                    best = i;
+                    bestCycle = cycle;
+                }
+            }
+            order.push_back(best);
+            ordered[best] = true;
+            current = bestCycle.endPos;
+        }
+    }
+
+    //Cheapest insertion of the new blocks
+    for(int i = 0; i < n && !outOfTime(); i++){
+        if(ordered[i]) continue;
+        int bestPos = order.size();
+        float bestTime = -1;
+        for(int p = 0; p <= order.size(); p++){
+            order.insert(order.begin() + p, i);
+            float time = evaluate(order);
+            order.erase(order.begin() + p);
+            if(bestTime < 0 || time < bestTime){
+                bestTime = time;
+                bestPos = p;
+            }
+        }
+        order.insert(order.begin() + bestPos, i);
+        ordered[i] = true;
+    }
+
+    //Out of time: the blocks left are picked last
+    for(int i = 0; i < n; i++)
+        if(!ordered[i]) order.push_back(i);
+
+    //Local search with 2-opt (segment reversal) and Or-opt (move a segment of up to 3 blocks)
+    float bestTime = evaluate(order);
+    bool improved = true;
+    while(improved && !outOfTime()){
+        improved = false;
+
+        for(int i = 0; i < n - 1 && !outOfTime(); i++){
+            for(int j = i + 1; j < n; j++){
+                vector<int> candidate = order;
+                reverse(candidate.begin() + i, candidate.begin() + j + 1);
+                float time = evaluate(candidate);
+                if(time < bestTime - 1e-4){
+                    order = candidate;
+                    bestTime = time;
+                    improved = true;
+                }
+            }
+        }
+
+        for(int len = 1; len <= 3 && !outOfTime(); len++){
+            for(int i = 0; i + len <= n; i++){
+                for(int p = 0; p <= n - len; p++){
+                    if(p == i) continue;
+                    vector<int> candidate = order;
+                    vector<int> segment(candidate.begin() + i, candidate.begin() + i + len);
+                    candidate.erase(candidate.begin() + i, candidate.begin() + i + len);
+                    candidate.insert(candidate.begin() + p, segment.begin(), segment.end());
+                    float time = evaluate(candidate);
+                    if(time < bestTime - 1e-4){
+                        order = candidate;
+                        bestTime = time;
+                        improved = true;
+                    }
+                }
+            }
+        }
+    }
+
+    return order;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file pipelineBenchmark.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the end to end benchmark of the vision, planner and move pipeline on the in-process message bus
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The planner runs its real callbacks on the message bus, without a ROS master, with the simulated vision node and arms
+ * of simulatedCell.cpp: the vision node reports a random scene on every detection request and every arm takes the time
+ * of the cycle time model, scaled down, to execute an order.
+ *
+ * Usage: pipeline_benchmark [blocks] [latency ms] [jitter ms] [arm time scale] [seed] [arms]
+ */
+
+#define PLANNER_NODELET // the main function of the planner is not compiled
+#include "planner.cpp"
+#include "simulatedCell.cpp" // Simulated vision node and arms on the message bus
+
+#include <cstdlib>
+
+///Maximum duration of the benchmark [s]
+#define BENCHMARK_TIMEOUT 120.0
+
+/**
+ * @brief Stream buffer discarding everything, used to silence the planner during the benchmark
+ *
+ */
+class NullBuffer : public streambuf{
+protected:
+    int overflow(int c){ return c; }
+};
+
+int main(int argc, char **argv){
+
+    int blocks = argc > 1 ? atoi(argv[1]) : 20;
+    double latency = argc > 2 ? atof(argv[2]) / 1000 : 0.001;
+    double jitter = argc > 3 ? atof(argv[3]) / 1000 : 0;
+    armTimeScale = argc > 4 ? atof(argv[4]) : 0.01;
+    unsigned int seed = argc > 5 ? atoi(argv[5]) : 1;
+    int armCount = argc > 6 ? max(1, atoi(argv[6])) : 1;
+
+    //Random scene of spaced blocks in the workspace of the planner
+    mt19937 random(seed);
+    blocks = addSceneBlocks(blocks, random);
+
+    ros::Time::init();
+
+    setupSimulatedCell(armCount, latency, jitter);
+
+    cout << "Moving " << blocks << " blocks with " << armCount << " arms, latency " << latency * 1000 << " ms +- " << jitter * 1000
+         << " ms, arm time scale " << armTimeScale << endl;
+
+    NullBuffer nullBuffer;
+    streambuf* coutBuffer = cout.rdbuf();
+    cout.rdbuf(&nullBuffer);
+
+    double start = wallClock();
+    sendDetectionRequest();
+    flushPlanner();
+    bus.start();
+
+    {
+        unique_lock<mutex> guard(resultLock);
+        resultReady.wait_for(guard, chrono::duration<double>(BENCHMARK_TIMEOUT), [&](){ return placed >= blocks; });
+    }
+
+    bus.stop();
+    double wallTime = wallClock() - start;
+    cout.rdbuf(coutBuffer);
+
+    cout << "Placed " << placed << "/" << blocks << " blocks with " << results - placed << " failures in " << wallTime << " s ("
+         << placed * 60 / wallTime << " blocks per minute)" << endl;
+
+    MetricsSummary summary = metrics.summary(wallClock());
+    for(int i = 0; i < summary.intervals.size(); i++)
+        cout << "  " << summary.intervals[i] << ": p50 " << summary.p50[i] * 1000 << " ms, p90 " << summary.p90[i] * 1000
+             << " ms, p99 " << summary.p99[i] * 1000 << " ms" << endl;
+
+    map<string, BusStats> stats = bus.stats();
+    for(auto it = stats.begin(); it != stats.end(); it++)
+        cout << "  " << it->first << ": " << it->second.delivered << " messages, dispatch lateness mean "
+             << it->second.lateness / max(1, it->second.delivered) * 1e6 << " us" << endl;
+
+    for(int a = 0; a < armCount; a++)
+        cout << "  arm " << a << ": " << dispatcher.arm(a).completed << " orders completed" << endl;
+
+    return placed == blocks ? 0 : 1;
+}
@@ -0,0 +1,273 @@
+/**
+ * @file planEvaluator.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the evaluator simulating candidate plans in parallel to choose the fastest feasible one
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * A candidate plan is a pick order, the grasp yaw of each block and the placement policy of the target area: the rotation
+ * of the placements and the best fit or the nearest free slot for each block. Each candidate
+ * is simulated on a copy of the target allocator, checking with the inverse kinematics that every grasp and release pose of
+ * moveObject() is reachable, and timed with the cycle time model. The candidates are spread over a pool of worker threads
+ * and the ones not started before the deadline are skipped. With orderSolveEvaluations set every candidate is simulated and
+ * the deadline is ignored, so that the choice does not depend on the speed of the machine.
+ * Needs kinematicsUr5.cpp, pickOrder.cpp and targetAllocator.cpp to be included before this file.
+ */
+
+#include <iostream>
+#include <Eigen/Dense>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+using Eigen::Vector3f;
+
+/**
+ * @brief Struct to store a candidate plan and the result of its simulation
+ *
+ */
+struct CandidatePlan{
+    vector<int> order; // indexes of the blocks in the order they are picked, optimised before the simulation if optimise is set
+    vector<float> graspYaw; // yaw of the gripper in the base frame for each block [rad]
+    vector<bool> flippedGrasp; // the gripper of each block is turned by pi from the yaw of the block
+    bool allowRotation; // placements of the target area can be rotated
+    bool nearestSlot; // each block takes the free slot of the target area nearest to it instead of the best fit
+    bool optimise;
+
+    bool evaluated; // simulated before the deadline
+    bool feasible; // every block fits and every pose is reachable
+    float time; // estimated time to move all the blocks [s]
+    vector<Vector3f> targets; // world frame target of each block
+};
+
+/**
+ * @brief Struct to store what the candidates of a plan share
+ *
+ */
+struct PlanningScene{
+    vector<Vector3f> blockPos; // world frame position of each block
+    vector<int> blockClass;
+    vector<Vector3f> estimatedTargets; // target of each block used to optimise the order
+    vector<Vector3f> fallbackTargets; // target of each block when the target area is full
+    const TargetAllocator* allocator; // current state of the target area, null to use the estimated targets
+    Vector3f startPos; // base frame position of the end effector before the first pick
+};
+
+bool isReachable(Vector3f position, float yaw); // Check if the end effector can reach a base frame pose
+void simulatePlan(CandidatePlan& plan, const PlanningScene& scene, chrono::steady_clock::time_point deadline); // Simulate a candidate plan
+
+/**
+ * @brief Pool of threads simulating candidate plans
+ *
+ */
+class PlanEvaluator{
+public:
+    PlanEvaluator(int threads = 0); // 0 to use a thread per core
+    ~PlanEvaluator();
+
+    int evaluate(vector<CandidatePlan>& candidates, const PlanningScene& scene, float deadline); // Simulate the candidates and return the fastest feasible one
+
+private:
+    int threadCount;
+    vector<thread> workers;
+    mutex lock;
+    condition_variable workReady; // a new batch of candidates is available
+    condition_variable batchDone; // a worker is done with the batch
+
+    vector<CandidatePlan>* candidates; // batch being evaluated
+    const PlanningScene* scene;
+    chrono::steady_clock::time_point deadline;
+    atomic<int> next; // next candidate to simulate
+    int finished; // workers done with the current batch
+    unsigned int batch; // number of the current batch
+    bool stopping;
+
+    void workerLoop();
+};
+
+/**
+ * @brief Check if the end effector can reach a base frame position pointing down with a given yaw, that is if the inverse
+ * kinematics has at least one finite solution
+ *
+ * @param position
+ * @param yaw
+ * @return true
+ * @return false
+ */
+bool isReachable(Vector3f position, float yaw){
+
+    EEPose pose;
+    pose.Pe = position;
+    pose.Re = Eigen::AngleAxisf(yaw, Vector3f::UnitZ()).toRotationMatrix();
+
+    MatrixXf solutions = invKin(pose);
+    for(int i = 0; i < solutions.rows(); i++)
+        if(solutions.row(i).allFinite()) return true;
+
+    return false;
+}
+
+/**
+ * @brief Simulate a candidate plan: optimise its order if requested, allocate its targets on a copy of the target area,
+ * check that the grasp and release poses are reachable and estimate its total time
+ *
+ * @param plan
+ * @param scene
+ * @param deadline
+ */
+void simulatePlan(CandidatePlan& plan, const PlanningScene& scene, chrono::steady_clock::time_point deadline){
+
+    int n = scene.blockPos.size();
+
+    if(plan.optimise){
+        float budget = chrono::duration<float, milli>(deadline - chrono::steady_clock::now()).count();
+        plan.order = optimisePickOrder(scene.blockPos, scene.estimatedTargets, plan.order, scene.startPos, min(budget, (float)ORDER_SOLVE_BUDGET));
+    }
+    if(plan.graspYaw.size() < n) plan.graspYaw.resize(n, 0);
+
+    plan.targets = scene.estimatedTargets;
+    plan.feasible = true;
+
+    TargetAllocator allocator;
+    if(scene.allocator) allocator = *scene.allocator;
+
+    for(int i = 0; i < plan.order.size(); i++){
+        int b = plan.order[i];
+        float releaseYaw = 0; // yaw of the block at the release, the move node turns the gripper to it
+
+        if(scene.allocator){
+            Placement placement;
+            bool allocated = plan.nearestSlot ? allocator.allocateNear(scene.blockClass[b], plan.allowRotation, scene.blockPos[b], placement)
+                                              : allocator.allocate(scene.blockClass[b], plan.allowRotation, placement);
+            if(allocated){
+                plan.targets[b] = placement.position;
+                releaseYaw = placement.yaw;
+            }else{
+                plan.targets[b] = scene.fallbackTargets[b];
+            }
+        }
+
+        //Same grasp and release heights used by the move node
+        Vector3f grasp = scene.blockPos[b];
+        grasp(2) = GRASP_HEIGHT;
+        Vector3f release = plan.targets[b];
+        release(2) = GRASP_HEIGHT + max(0.0f, release(2) - (float)TABLE_PLACE_HEIGHT);
+
+        if(!isReachable(transformationWorldToBase(grasp), plan.graspYaw[b]) || !isReachable(transformationWorldToBase(release), yawWorldToBase(releaseYaw))){
+            plan.feasible = false;
+            break;
+        }
+    }
+
+    plan.time = sequenceTime(scene.blockPos, plan.targets, plan.order, scene.startPos);
+    plan.evaluated = true;
+}
+
+/**
+ * @brief Construct the evaluator, the worker threads are started at the first evaluation
+ *
+ * @param threads number of worker threads, 0 to use a thread per core
+ */
+PlanEvaluator::PlanEvaluator(int threads){
+    threadCount = threads > 0 ? threads : max(1u, thread::hardware_concurrency());
+    candidates = NULL;
+    scene = NULL;
+    finished = 0;
+    batch = 0;
+    stopping = false;
+}
+
+/**
+ * @brief Stop and join the worker threads
+ *
+ */
+PlanEvaluator::~PlanEvaluator(){
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    workReady.notify_all();
+    for(int i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+/**
+ * @brief Loop of a worker thread: wait for a batch and simulate its candidates until they are over or the deadline passes
+ *
+ */
+void PlanEvaluator::workerLoop(){
+
+    unsigned int lastBatch = 0;
+
+    while(true){
+        {
+            unique_lock<mutex> guard(lock);
+            workReady.wait(guard, [&](){ return stopping || batch != lastBatch; });
+            if(stopping) return;
+            lastBatch = batch;
+        }
+
+        int i;
+        while((orderSolveEvaluations > 0 || chrono::steady_clock::now() < deadline) && (i = next++) < candidates->size())
+            simulatePlan((*candidates)[i], *scene, deadline);
+
+        {
+            lock_guard<mutex> guard(lock);
+            finished++;
+        }
+        batchDone.notify_one();
+    }
+}
+
+/**
+ * @brief Simulate the candidates in parallel within a deadline and return the fastest feasible one.
+ * The candidates not started before the deadline are left not evaluated, unless orderSolveEvaluations is set
+ *
+ * @param candidates
+ * @param scene
+ * @param deadline time budget [ms]
+ * @return int index of the chosen candidate, -1 if no candidate is feasible
+ */
+int PlanEvaluator::evaluate(vector<CandidatePlan>& candidates, const PlanningScene& scene, float deadline){
+
+    for(int i = 0; i < candidates.size(); i++){
+        candidates[i].evaluated = false;
+        candidates[i].feasible = false;
+    }
+
+    {
+        unique_lock<mutex> guard(lock);
+
+        while(workers.size() < threadCount)
+            workers.push_back(thread(&PlanEvaluator::workerLoop, this));
+
+        this->candidates = &candidates;
+        this->scene = &scene;
+        this->deadline = chrono::steady_clock::now() + chrono::microseconds((long)(deadline * 1000));
+        next = 0;
+        finished = 0;
+        batch++;
+        workReady.notify_all();
+
+        //Wait until every worker is done with the batch, the candidates must outlive it
+        batchDone.wait(guard, [&](){ return finished == workers.size(); });
+        this->candidates = NULL;
+        this->scene = NULL;
+    }
+
+    int best = -1;
+    for(int i = 0; i < candidates.size(); i++){
+        if(!candidates[i].evaluated || !candidates[i].feasible) continue;
+        if(best < 0 || candidates[i].time < candidates[best].time)
+            best = i;
+    }
+
+    return best;
+}
@@ -26,65 +26,195 @@
 
 #include <iostream>
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 
 #include <std_msgs/Bool.h> // Message type for vision node for detection request
-#include <cpp_publisher/Coordinates.h> // Message type for move node with coordinates of the block, target zone and block id
+#include <cpp_publisher/CoordinatesV2.h> // Message type for move node with coordinates of the block, target zone, block id and trace id
+#include <cpp_publisher/Coordinates.h> // Original message type for move node, still published for the tools using it
 #include <cpp_publisher/BlockInfo.h> // Message type for vision node with block position, class and id
-#include <cpp_publisher/MoveOperation.h> // Message type for move node with move operation result
+#include <cpp_publisher/BlockInfoArray.h> // Message type for vision node with every block detected in a frame
+#include <cpp_publisher/MoveOperationV2.h> // Message type for move node with move operation result
+#include <cpp_publisher/CellMetrics.h> // Message type for the throughput and latency metrics
 
 #include <Eigen/Dense>
 #include <vector>
+#include <deque>
+#include <map>
+#include <random>
+#include <numeric>
+#include <mutex>
+#include <cstdint>
+#include <unistd.h>
+#include <boost/bind.hpp>
+
+#include "kinematicsUr5.cpp" // Kinematics of the UR5, used to check the reachability of the plans
+#include "frame2frame.cpp" // Functions for frame to frame transformations (world to base)
+#include "pickOrder.cpp" // Cycle time model of the move node and pick order optimiser
+#include "targetAllocator.cpp" // Allocator of the placements in the target area
+#include "assemblyPlanner.cpp" // Planner of the assembly of a structure
+#include "planEvaluator.cpp" // Parallel simulation of candidate plans
+#include "poseFilter.cpp" // Filter fusing the detections of a block
+#include "blockRegistry.cpp" // Registry of the known blocks
+#include "cellMetrics.cpp" // Throughput and latency metrics
+#include "sessionLog.cpp" // Binary log of the messages received
+#include "armDispatcher.cpp" // Dispatcher of the blocks between the arms
 
 ///Set to 1 to test without vision
 #define DEBUG 1
+///Set to 1 to consume every block of a detection pass through the work queue instead of one block per request
+#define BATCH_DETECTION 1
+///Set to 1 to reorder the work queue minimising the total cycle time
+#define OPTIMISE_ORDER 1
+///Set to 1 to ask for the next detection while the arm is still moving, as soon as it leaves the camera view
+#define PIPELINED_DETECTION 1
 ///Number of different block classes
 #define BLOCK_CLASSES 11
+///Set to 1 to pack the blocks in the target area instead of using one slot per class
+#define PACKED_TARGET_ZONE 1
+///Set to 1 to allow placing the blocks rotated by pi/2 in the target area
+#define ROTATED_PLACEMENT 1
+///World frame position of the origin of the structure to assemble, between the pick area and the target area [m]
+#define STRUCTURE_ORIGIN_X 0.575
+#define STRUCTURE_ORIGIN_Y 0.45
+///Number of pick orders simulated each time the work queue is reordered
+#define PLAN_CANDIDATES 8
+///Deadline of the simulation of the candidate plans [ms]
+#define PLAN_DEADLINE 20.0
+///Time a candidate plan has to save over the current order to replace it, smaller gains are within the error of the cycle time model [s]
+#define PLAN_MIN_GAIN 0.5
+///Minimum confidence of a detection to be queued
+#define MIN_CONFIDENCE 0.5
+///Time after which a message still waiting for a subscriber is reported, the move orders are given back to the work queue [s]
+#define CONNECTION_TIMEOUT 5.0
+///Period of the retries of the messages waiting for a subscriber [s]
+#define CONNECTION_RETRY 0.5
+///Length of the rolling window of the metrics [s]
+#define METRICS_WINDOW 300.0
+///Period of the metrics publication and log [s]
+#define METRICS_PERIOD 10.0
+///Period of the search of new move nodes, if the discover_arms parameter is set [s]
+#define ARM_DISCOVERY_PERIOD 5.0
 
 using namespace std;
 using Eigen::Vector3f;
 
+/**
+ * @brief Struct to store the topics of the move node of an arm, all relative to the namespace of the arm
+ *
+ */
+struct ArmLink{
+    string ns; // namespace of the move node, empty for the root namespace
+    ros::Publisher movePublisher;
+    ros::Publisher legacyMovePublisher; // original Coordinates messages on the original topic
+    ros::Subscriber moveSubscriber, progressSubscriber;
+    deque<cpp_publisher::CoordinatesV2> pendingMoveOrders; // move orders waiting for the move node to subscribe
+    ros::Time moveOrdersSince; // time since the oldest pending move order is waiting
+    Vector3f transitTarget; // target of the block moved by the arm
+};
+
 //=======GLOBAL VARIABLES=======
-///Publisher for sending move orders
-ros::Publisher movePublisher;
+///Topics of the arms, in the same order as the arms of the dispatcher
+vector<ArmLink> arms;
+///Dispatcher of the blocks between the arms, it tracks the block moved by each arm
+ArmDispatcher dispatcher;
 ///Publisher for sending detection requests
 ros::Publisher visionPublisher;
+///Publisher for the throughput and latency metrics
+ros::Publisher metricsPublisher;
+///Subscriber to the vision node
+ros::Subscriber visionSubscriber;
+///Timers of the connection watchdog, of the metrics and of the discovery of the arms
+ros::Timer watchdogTimer, metricsTimer, discoveryTimer;
+///Log of the messages received, open only if the session_log parameter is set
+SessionLog sessionLog;
+///Callback queues of the vision node messages and of the move node messages, each one served by its own thread
+ros::CallbackQueue visionQueue, moveQueue;
+///Threads serving the callback queues
+boost::shared_ptr<ros::AsyncSpinner> visionSpinner, moveSpinner;
+///Lock of the state of the planner, held by every callback except while the candidate plans are simulated
+mutex plannerLock;
 ///Vector containing the number of blocks of each class in the table to calculate the target zone offset
 vector<int> blockPerClass(BLOCK_CLASSES, 0);
+///Occupancy grid of the target area
+TargetAllocator targetAllocator;
+///Planner of the structure to assemble, active only if a structure file is given
+AssemblyPlanner assembly;
+///Registry of the blocks known by the planner
+BlockRegistry registry;
+///Timelines of the blocks for the metrics
+CellMetrics metrics(METRICS_WINDOW);
+///Time of the last detection request
+ros::Time detectionRequestedAt;
+///Thread pool simulating the candidate plans
+PlanEvaluator planEvaluator;
+///True if the placements in the target area can be rotated, chosen by the last plan
+bool allowRotation = ROTATED_PLACEMENT;
+///True if each block takes the free slot of the target area nearest to it instead of the best fit, chosen by the last plan
+bool nearestSlot = false;
+///Queue of the ids of the blocks on the table waiting to be moved
+deque<int> workQueue;
+///True while a detection request is waiting for the vision node answer
+bool detectionPending = false;
+///Detection requests waiting for the vision node to subscribe
+deque<std_msgs::Bool> pendingDetectionRequests;
+///Time since the oldest pending detection request is waiting for the vision node
+ros::Time detectionRequestsSince;
+///Number of traces started by the planner, for the detections received without a trace
+uint32_t traceCounter = 0;
+///Clock of the planner, the ROS clock unless a simulated cell sets its own
+ros::Time (*plannerClock)() = ros::Time::now;
 
 //=======FUNCTION DECLARATION=======
-void sendMoveOrder(Vector3f blockPos, int blockClass, int blockId); // Send move order to move node
+void setupPlanner(ros::NodeHandle n, ros::NodeHandle privateNode); // Advertise and subscribe the planner topics
+int addArm(string ns, Vector3f baseOffset); // Add an arm to the dispatcher
+void connectArm(int arm, ros::NodeHandle n, ros::NodeHandle moveNode); // Advertise and subscribe the topics of an arm
+Vector3f armBaseOffset(ros::NodeHandle n, string ns); // Read the base offset of an arm
+void discoverArms(const ros::TimerEvent& event, ros::NodeHandle n, ros::NodeHandle moveNode); // Connect the move nodes started in new namespaces
+void sendMoveOrder(int arm, Vector3f blockPos, float blockYaw, Vector3f target, float targetYaw, int blockId, uint64_t traceId, Eigen::Matrix3f covariance); // Send move order to move node
 void visionCallback(const cpp_publisher::BlockInfo::ConstPtr& msg); // Callback for vision node
-void movementCallback(const cpp_publisher::MoveOperation::ConstPtr& msg); // Callback for move node
+void visionArrayCallback(const cpp_publisher::BlockInfoArray::ConstPtr& msg); // Callback for vision node batch detections
+void movementCallback(const cpp_publisher::MoveOperationV2::ConstPtr& msg); // Callback for move node
+void progressCallback(const cpp_publisher::MoveOperationV2::ConstPtr& msg); // Callback for move node progress
+uint64_t newTraceId(); // Start a trace for a detection received without one
+void traceBlock(int id, uint64_t traceId); // Attach the trace of its first detection to a block
+void sendDetectionRequest(); // Ask the vision node for a new detection
+bool dispatchNextBlock(int arm); // Send the next block assigned to an arm to its move node
+void dispatchIdleArms(); // Send a block to every arm without a move order
+void assignWorkQueue(); // Assign the blocks of the work queue to the arms
+void startMove(int arm, int id, Vector3f target, float targetYaw); // Send a known block to the move node of an arm
+bool isQueued(int id); // Check if a block is in the work queue
+float graspYaw(const KnownBlock& block, bool flipped); // World frame yaw of the gripper grasping a block
+void reorderWorkQueue(int orderedBlocks, unique_lock<mutex>& guard); // Reorder the work queue minimising the total cycle time
+void moveConnected(const ros::SingleSubscriberPublisher& pub, int arm); // Flush the move orders when the move node of an arm subscribes
+void visionConnected(const ros::SingleSubscriberPublisher& pub); // Flush the detection requests when the vision node subscribes
+void connectionWatchdog(const ros::TimerEvent& event); // Retry the queued messages and give back the move orders waiting for too long
+bool moveNodeReady(int arm); // True if the move node of an arm is connected to the planner
+bool visionNodeReady(); // True if the vision node is connected to the planner
+void flushArm(int arm); // Publish the queued move orders of an arm once its move node is connected
+void requeueMoveOrders(int arm); // Give back to the work queue the move orders an arm did not take
+void publishMetrics(const ros::TimerEvent& event); // Publish and log the throughput and latency metrics
+void markStage(int id, BlockStage stage); // Record the time a block reaches a stage
+template<class M> void publishWhenConnected(const ros::Publisher& pub, bool ready, deque<M>& pending, ros::Time& since, const M& msg); // Publish or queue a message until its node connects
+template<class M> void flushPending(const ros::Publisher& pub, deque<M>& pending); // Publish the queued messages once their node is connected
 
-Vector3f getTargetZone(int blockClass); // Get the target zone for a block of a given class
+Placement getTargetZone(int blockClass, Vector3f blockPos); // Get the target zone and the yaw for a block of a given class
+Vector3f classSlot(int blockClass); // Get the slot of a given class in the target zone
+Vector3f estimateTargetZone(int blockClass); // Get the target zone the next block of a given class would get
 bool isInWorkspace(Vector3f blockPos); // Check if a block is in the workspace
 
+#ifndef PLANNER_NODELET
 int main(int argc, char **argv)
 {
     ros::init(argc, argv, "planner");
     ros::NodeHandle n;
+    ros::NodeHandle privateNode("~");
 
-    movePublisher = n.advertise<cpp_publisher::Coordinates>("/planner/position", 100);
-
-    visionPublisher = n.advertise<std_msgs::Bool>("/planner/detection_request", 100);
+    setupPlanner(n, privateNode);
 
-    ros::Subscriber visionSubscriber = n.subscribe("/vision/vision_detection", 100, visionCallback);
-
-    ros::Subscriber moveSubscriber = n.subscribe("/move/movement_results", 100, movementCallback);
-
-    cout << "waiting for subscribers" << endl;
-    
     if(!DEBUG){
-        while(ros::ok()){
-            if(visionPublisher.getNumSubscribers() > 0){
-                std_msgs::Bool msg;
-                msg.data = true;
-                if(DEBUG)cout << "Publishing detection request" << endl;
-                visionPublisher.publish(msg);
-                break;
-            }
-            ros::spinOnce();
-        }
+        //The request is queued until the vision node subscribes
+        lock_guard<mutex> guard(plannerLock);
+        sendDetectionRequest();
     }else{
         while(ros::ok()){
             Vector3f blockPos;
@@ -94,8 +224,12 @@ int main(int argc, char **argv)
             int blockClass;
             cout << "Enter block class" << endl;
             cin >> blockClass;
-            if(isInWorkspace(blockPos))
-                sendMoveOrder(blockPos, blockClass, blockId);
+            if(isInWorkspace(blockPos)){
+                lock_guard<mutex> guard(plannerLock);
+                Placement target = getTargetZone(blockClass, blockPos);
+                sendMoveOrder(0, blockPos, 0, target.position, target.yaw, blockId, newTraceId(), Eigen::Matrix3f::Zero());
+            }
+            ros::spinOnce();
         }
         
     }
@@ -104,41 +238,368 @@ int main(int argc, char **argv)
 
     return 0;
 }
+#endif
+
 /**
- * @brief Sends the move order to the move node, with the block position, class and id
+ * @brief Load the parameters, advertise the planner topics and subscribe to the vision and move nodes.
+ * Shared by the standalone executable and the nodelet
  * 
+ * @param n node handle of the topics
+ * @param privateNode node handle of the private parameters
+ */
+void setupPlanner(ros::NodeHandle n, ros::NodeHandle privateNode){
+
+    //Structure to assemble, if not given the blocks are moved to the target area
+    string structureFile;
+    privateNode.param<string>("structure", structureFile, "");
+    if(!structureFile.empty())
+        assembly.load(structureFile, Vector3f(STRUCTURE_ORIGIN_X, STRUCTURE_ORIGIN_Y, 0));
+
+    //Log of the session, replayed offline by session_replay
+    string logFile;
+    privateNode.param<string>("session_log", logFile, "");
+    if(!logFile.empty())
+        sessionLog.open(logFile);
+
+    visionPublisher = n.advertise<std_msgs::Bool>("/planner/detection_request", 100, visionConnected);
+
+    watchdogTimer = n.createTimer(ros::Duration(CONNECTION_RETRY), connectionWatchdog);
+
+    metricsPublisher = n.advertise<cpp_publisher::CellMetrics>("/planner/metrics", 10);
+
+    metricsTimer = n.createTimer(ros::Duration(METRICS_PERIOD), publishMetrics);
+
+    //The detections and the move node messages are served by different threads, so that a plan being simulated
+    //for new detections does not delay the acks of the move node. Timers and connection callbacks stay on the default queue
+    ros::NodeHandle visionNode(n), moveNode(n);
+    visionNode.setCallbackQueue(&visionQueue);
+    moveNode.setCallbackQueue(&moveQueue);
+
+    if(BATCH_DETECTION)
+        visionSubscriber = visionNode.subscribe("/vision/vision_detections", 100, visionArrayCallback);
+    else
+        visionSubscriber = visionNode.subscribe("/vision/vision_detection", 100, visionCallback);
+
+    //Move nodes of the arms, by default a single one in the root namespace. The arms in other namespaces can also be
+    //connected when their move node starts
+    vector<string> armNamespaces;
+    privateNode.param<vector<string>>("arms", armNamespaces, vector<string>(1, ""));
+    for(int i = 0; i < armNamespaces.size(); i++)
+        connectArm(addArm(armNamespaces[i], armBaseOffset(n, armNamespaces[i])), n, moveNode);
+
+    bool discover;
+    privateNode.param<bool>("discover_arms", discover, false);
+    if(discover)
+        discoveryTimer = n.createTimer(ros::Duration(ARM_DISCOVERY_PERIOD), boost::bind(discoverArms, _1, n, moveNode));
+
+    visionSpinner.reset(new ros::AsyncSpinner(1, &visionQueue));
+    moveSpinner.reset(new ros::AsyncSpinner(1, &moveQueue));
+    visionSpinner->start();
+    moveSpinner->start();
+}
+
+/**
+ * @brief Add an arm to the dispatcher, without topics until it is connected
+ * 
+ * @param ns namespace of the move node of the arm, empty for the root namespace
+ * @param baseOffset world frame offset of the base of the arm from the base of the single arm cell
+ * @return int index of the arm
+ */
+int addArm(string ns, Vector3f baseOffset){
+
+    ArmLink link;
+    link.ns = ns;
+    arms.push_back(link);
+
+    cout << "Arm " << arms.size() - 1 << " in namespace '" << ns << "' with base offset " << baseOffset.transpose() << endl;
+    return dispatcher.addArm(baseOffset);
+}
+
+/**
+ * @brief Advertise the move orders of an arm and subscribe to the results and progress of its move node
+ * 
+ * @param arm 
+ * @param n node handle of the topics
+ * @param moveNode node handle of the move node messages, on their own callback queue
+ */
+void connectArm(int arm, ros::NodeHandle n, ros::NodeHandle moveNode){
+
+    string ns = arms[arm].ns;
+    //The V2 messages have their own topics, the original topic keeps its message type for the tools still using it
+    arms[arm].movePublisher = n.advertise<cpp_publisher::CoordinatesV2>(ns + "/planner/position_v2", 100,
+        boost::bind(moveConnected, _1, arm));
+    arms[arm].legacyMovePublisher = n.advertise<cpp_publisher::Coordinates>(ns + "/planner/position", 100);
+    arms[arm].moveSubscriber = moveNode.subscribe(ns + "/move/movement_results_v2", 100, movementCallback);
+    arms[arm].progressSubscriber = moveNode.subscribe(ns + "/move/movement_progress_v2", 100, progressCallback);
+}
+
+/**
+ * @brief Read the base offset of an arm from the base_offset parameter of its namespace, the same one read by its move node
+ * 
+ * @param n 
+ * @param ns 
+ * @return Vector3f zero if the parameter is not set
+ */
+Vector3f armBaseOffset(ros::NodeHandle n, string ns){
+
+    vector<double> offset;
+    n.param<vector<double>>(ns + "/base_offset", offset, vector<double>(2, 0.0));
+    if(offset.size() < 2)
+        return Vector3f::Zero();
+    return Vector3f(offset[0], offset[1], 0);
+}
+
+/**
+ * @brief Periodically look for move nodes publishing their results in a namespace not connected yet, and add their arms
+ * 
+ * @param event 
+ * @param n 
+ * @param moveNode 
+ */
+void discoverArms(const ros::TimerEvent& event, ros::NodeHandle n, ros::NodeHandle moveNode){
+
+    vector<ros::master::TopicInfo> topics;
+    if(!ros::master::getTopics(topics))
+        return;
+
+    lock_guard<mutex> guard(plannerLock);
+    const string suffix = "/move/movement_results_v2";
+
+    for(int i = 0; i < topics.size(); i++){
+        const string& name = topics[i].name;
+        if(name.size() < suffix.size() || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+            continue;
+
+        string ns = name.substr(0, name.size() - suffix.size());
+        bool known = false;
+        for(int a = 0; a < arms.size(); a++)
+            if(arms[a].ns == ns) known = true;
+        if(known) continue;
+
+        cout << "Discovered the move node of namespace '" << ns << "'" << endl;
+        connectArm(addArm(ns, armBaseOffset(n, ns)), n, moveNode);
+        dispatchIdleArms();
+    }
+}
+
+/**
+ * @brief Sends the move order to the move node of an arm, with the block position, its covariance, its target and id
+ * 
+ * @param arm 
  * @param blockPos 
- * @param blockClass 
+ * @param blockYaw yaw of the block in the world frame, the gripper grasps it along its short side
+ * @param target 
+ * @param targetYaw yaw of the block at the release in the world frame, 0 or pi/2 in the target area
  * @param blockId 
+ * @param traceId trace of the detection of the block, echoed back by the move node
+ * @param covariance covariance of the block position, zero if unknown
  */
-void sendMoveOrder(Vector3f blockPos, int blockClass, int blockId){
+void sendMoveOrder(int arm, Vector3f blockPos, float blockYaw, Vector3f target, float targetYaw, int blockId, uint64_t traceId, Eigen::Matrix3f covariance){
 
-    cout << "Sending move order" << endl;
-    
-    while(ros::ok()){
-        cout << "Waiting for subscribers" << endl;
-        if(movePublisher.getNumSubscribers() > 0){
-            cout << "Publishing" << endl;
-            cpp_publisher::Coordinates msg;
+    cout << "Sending move order (trace " << hex << traceId << dec << ")" << endl;
 
-            std_msgs::Byte byteMsg;
-            byteMsg.data = blockId;
-            msg.blockId = byteMsg;
+    cpp_publisher::CoordinatesV2 msg;
 
-            msg.from.x = blockPos(0);
-            msg.from.y = blockPos(1);
-            msg.from.z = blockPos(2);
+    //The stamp is the time the order is sent, the move node measures the transport latency with it
+    msg.header.stamp = plannerClock();
+    msg.header.frame_id = "world";
+    msg.blockId = blockId;
+    msg.traceId = traceId;
 
-            Vector3f target = getTargetZone(blockClass);
+    msg.from.x = blockPos(0);
+    msg.from.y = blockPos(1);
+    msg.from.z = blockPos(2);
+    msg.fromYaw = blockYaw;
 
-            msg.to.x = target(0);
-            msg.to.y = target(1);
-            msg.to.z = target(2);
+    msg.to.x = target(0);
+    msg.to.y = target(1);
+    msg.to.z = target(2);
+    msg.toYaw = targetYaw;
 
-            if(msg.from.x < 0.5)movePublisher.publish(msg);
-            
-            break;
-        }
+    for(int i = 0; i < 3; i++)
+        for(int j = 0; j < 3; j++)
+            msg.fromCovariance[3 * i + j] = covariance(i, j);
+
+    publishWhenConnected(arms[arm].movePublisher, moveNodeReady(arm), arms[arm].pendingMoveOrders, arms[arm].moveOrdersSince, msg);
+
+    //Copy of the order in the original message, only the block id of a byte and the positions
+    if(arms[arm].legacyMovePublisher.getNumSubscribers() > 0){
+        cpp_publisher::Coordinates legacyMsg;
+        legacyMsg.blockId.data = blockId;
+        legacyMsg.from = msg.from;
+        legacyMsg.to = msg.to;
+        arms[arm].legacyMovePublisher.publish(legacyMsg);
+    }
+}
+
+/**
+ * @brief Publish a message if the node it is meant for is connected, otherwise queue it until the node connects.
+ * Messages already queued are sent first to keep the order. The message is published as a shared pointer,
+ * so that a subscriber in the same process receives it without serialisation
+ * 
+ * @tparam M 
+ * @param pub 
+ * @param ready true if the node the message is meant for is connected
+ * @param pending queue of the messages waiting for the node
+ * @param since time since the oldest message of the queue is waiting
+ * @param msg 
+ */
+template<class M> void publishWhenConnected(const ros::Publisher& pub, bool ready, deque<M>& pending, ros::Time& since, const M& msg){
+
+    if(pending.empty() && ready){
+        pub.publish(boost::make_shared<const M>(msg));
+        return;
+    }
+
+    cout << "Waiting for subscribers on " << pub.getTopic() << endl;
+    if(pending.empty())
+        since = plannerClock();
+    pending.push_back(msg);
+}
+
+/**
+ * @brief Publish the queued messages to every subscriber of a publisher, once the node they are meant for is connected.
+ * They are not sent to the single subscriber that just connected, which could be a tool like rostopic echo
+ * 
+ * @tparam M 
+ * @param pub 
+ * @param pending 
+ */
+template<class M> void flushPending(const ros::Publisher& pub, deque<M>& pending){
+
+    if(pending.empty())
+        return;
+
+    cout << "Node connected on " << pub.getTopic() << ", publishing " << pending.size() << " queued messages" << endl;
+
+    while(!pending.empty()){
+        pub.publish(boost::make_shared<const M>(pending.front()));
+        pending.pop_front();
+    }
+}
+
+/**
+ * @brief True if the move node of an arm is connected to the planner: it subscribes to the move orders and publishes the
+ * results. A tool subscribing to the move orders does not publish the results
+ * 
+ * @param arm 
+ * @return true 
+ * @return false 
+ */
+bool moveNodeReady(int arm){
+    return arms[arm].movePublisher.getNumSubscribers() > 0 && arms[arm].moveSubscriber.getNumPublishers() > 0;
+}
+
+/**
+ * @brief True if the vision node is connected to the planner: it subscribes to the detection requests and publishes the
+ * detections
+ * 
+ * @return true 
+ * @return false 
+ */
+bool visionNodeReady(){
+    return visionPublisher.getNumSubscribers() > 0 && visionSubscriber.getNumPublishers() > 0;
+}
+
+/**
+ * @brief Publish the queued move orders of an arm once its move node is connected, and assign blocks again to an arm
+ * put offline by the watchdog
+ * 
+ * @param arm 
+ */
+void flushArm(int arm){
+
+    if(!moveNodeReady(arm))
+        return;
+
+    flushPending(arms[arm].movePublisher, arms[arm].pendingMoveOrders);
+
+    if(dispatcher.arm(arm).offline){
+        cout << "Move node of arm " << arm << " connected again" << endl;
+        dispatcher.setOffline(arm, false);
+        dispatchIdleArms();
+    }
+}
+
+/**
+ * @brief Give back to the work queue the move orders an arm did not take, and stop assigning blocks to the arm until its
+ * move node connects. The blocks are dispatched to the other arms
+ * 
+ * @param arm 
+ */
+void requeueMoveOrders(int arm){
+
+    deque<cpp_publisher::CoordinatesV2>& pending = arms[arm].pendingMoveOrders;
+    cout << "Timeout: " << pending.size() << " move orders waiting for the move node on " << arms[arm].movePublisher.getTopic()
+         << ", giving them back to the work queue" << endl;
+
+    dispatcher.setOffline(arm, true);
+
+    //In reverse, so that the blocks keep their order at the front of the queue
+    for(int i = pending.size() - 1; i >= 0; i--){
+        int id = pending[i].blockId;
+        if(dispatcher.armOf(id) != arm) continue; //order sent without a known block
+        dispatcher.withdraw(arm, plannerClock().toSec());
+        registry.setState(id, BLOCK_ON_TABLE);
+        if(assembly.active()) assembly.completePlacement(id, false);
+        if(!isQueued(id)) workQueue.push_front(id);
+    }
+    pending.clear();
+
+    dispatchIdleArms();
+}
+
+/**
+ * @brief Connection callback of the move orders publisher of an arm, the queued orders are published only if the
+ * subscriber is the move node
+ * 
+ * @param pub 
+ * @param arm 
+ */
+void moveConnected(const ros::SingleSubscriberPublisher& pub, int arm){
+    lock_guard<mutex> guard(plannerLock);
+    if(!moveNodeReady(arm))
+        cout << "Subscriber " << pub.getSubscriberName() << " on " << pub.getTopic() << " is not the move node yet, the orders stay queued" << endl;
+    flushArm(arm);
+}
+
+/**
+ * @brief Connection callback of the detection requests publisher, the queued requests are published only if the
+ * subscriber is the vision node
+ * 
+ * @param pub 
+ */
+void visionConnected(const ros::SingleSubscriberPublisher& pub){
+    lock_guard<mutex> guard(plannerLock);
+    if(visionNodeReady())
+        flushPending(visionPublisher, pendingDetectionRequests);
+    else
+        cout << "Subscriber " << pub.getSubscriberName() << " on " << pub.getTopic() << " is not the vision node yet, the requests stay queued" << endl;
+}
+
+/**
+ * @brief Periodically publish the messages whose node connected since they were queued. The move orders waiting for more
+ * than CONNECTION_TIMEOUT are given back to the work queue, the detection requests are reported and reduced to a single one
+ * 
+ * @param event 
+ */
+void connectionWatchdog(const ros::TimerEvent& event){
+
+    lock_guard<mutex> guard(plannerLock);
+    ros::Time now = plannerClock();
+
+    for(int a = 0; a < arms.size(); a++){
+        flushArm(a);
+        if(!arms[a].pendingMoveOrders.empty() && (now - arms[a].moveOrdersSince).toSec() >= CONNECTION_TIMEOUT)
+            requeueMoveOrders(a);
+    }
+
+    if(visionNodeReady())
+        flushPending(visionPublisher, pendingDetectionRequests);
+    if(!pendingDetectionRequests.empty() && (now - detectionRequestsSince).toSec() >= CONNECTION_TIMEOUT){
+        cout << "Timeout: " << pendingDetectionRequests.size() << " detection requests waiting for the vision node on " << visionPublisher.getTopic() << endl;
+        pendingDetectionRequests.resize(1); //the requests are all the same, one is enough once the vision node connects
+        detectionRequestsSince = now;
     }
 }
 
@@ -146,15 +607,54 @@ void sendMoveOrder(Vector3f blockPos, int blockClass, int blockId){
  * @brief Get the target zone where to place a block of a given class
  * 
  * @param blockClass 
+ * @param blockPos world frame position of the block, the nearest free slot is taken if the last plan chose so
+ * @return Placement position and yaw of the block at the release
+ */
+Placement getTargetZone(int blockClass, Vector3f blockPos){
+
+    blockPerClass[blockClass]+=1; // Increment the number of blocks of this class
+
+    if(PACKED_TARGET_ZONE){
+        Placement placement;
+        bool allocated = nearestSlot ? targetAllocator.allocateNear(blockClass, allowRotation, blockPos, placement)
+                                     : targetAllocator.allocate(blockClass, allowRotation, placement);
+        if(allocated)
+            return placement;
+        cout << "Target area full, using the slot of class " << blockClass << endl;
+    }
+
+    Placement slot;
+    slot.position = classSlot(blockClass);
+    slot.yaw = 0;
+    return slot;
+}
+
+/**
+ * @brief Get the target zone the next block of a given class would get, without reserving it
+ * 
+ * @param blockClass 
  * @return Vector3f 
  */
-Vector3f getTargetZone(int blockClass){
+Vector3f estimateTargetZone(int blockClass){
 
-    Vector3f target;
+    if(PACKED_TARGET_ZONE){
+        Placement placement;
+        if(targetAllocator.preview(blockClass, allowRotation, placement))
+            return placement.position;
+    }
+
+    return classSlot(blockClass);
+}
 
-    float offset = 0.07 * blockPerClass[blockClass-1]; // 0.05 is the offset between blocks of same class
+/**
+ * @brief Get the slot of the target zone reserved to a given class
+ * 
+ * @param blockClass 
+ * @return Vector3f 
+ */
+Vector3f classSlot(int blockClass){
 
-    blockPerClass[blockClass-1]+=1; // Increment the number of blocks of this class
+    Vector3f target;
 
     switch (blockClass)
     {
@@ -197,7 +697,7 @@ Vector3f getTargetZone(int blockClass){
 }
 
 /**
- * @brief Given a block position, check if it is in the workspace (table)
+ * @brief Given a block position, check if it is on the table in the pick area of one of the arms
  * 
  * @param blockPos 
  * @return true 
@@ -205,9 +705,11 @@ Vector3f getTargetZone(int blockClass){
  */
 bool isInWorkspace(Vector3f blockPos){
 
-    if(blockPos(0) > 0.05 && blockPos(0) < 0.5 && blockPos(1) > 0.05 && blockPos(1) < 0.75 && blockPos(2) > 0.86 && blockPos(2) < 0.92){
-        return true;
-    }
+    if(blockPos(2) <= 0.86 || blockPos(2) >= 0.92)
+        return false;
+
+    for(int a = 0; a < dispatcher.arms(); a++)
+        if(dispatcher.reaches(a, blockPos)) return true;
     return false;
 }
 
@@ -218,17 +720,377 @@ bool isInWorkspace(Vector3f blockPos){
  */
 void visionCallback(const cpp_publisher::BlockInfo::ConstPtr& msg){
     
+    sessionLog.record(LOG_DETECTION, *msg, plannerClock().toSec());
+    lock_guard<mutex> guard(plannerLock);
+
     cout << "Received vision callback" << endl;
     
     // Send move order
     Vector3f blockPos;
     blockPos << msg->blockPosition.x, msg->blockPosition.y, msg->blockPosition.z;
-    int blockId = msg->blockId.data;
     int blockClass = msg->blockClass.data;
 
-    if(isInWorkspace(blockPos))
-        sendMoveOrder(blockPos, blockClass, blockId);
+    if(!isInWorkspace(blockPos))
+        return;
 
+    bool isNew;
+    int id = registry.associate(blockPos, blockClass, 0, 1.0, plannerClock().toSec(), isNew);
+    if(registry.get(id).state != BLOCK_ON_TABLE || isQueued(id)){
+        cout << "Block " << id << " already moved or queued, skipping it" << endl;
+        return;
+    }
+
+    traceBlock(id, 0);
+    markStage(id, STAGE_REQUESTED);
+    markStage(id, STAGE_DETECTED);
+
+    //One block per request, queued as the batch detections: an idle arm takes it now, a busy one when its order is over
+    workQueue.push_back(id);
+    dispatchIdleArms();
+}
+
+/**
+ * @brief Callback for vision node which receives every block detected in a frame and adds them to the work queue
+ * 
+ * @param msg 
+ */
+void visionArrayCallback(const cpp_publisher::BlockInfoArray::ConstPtr& msg){
+
+    sessionLog.record(LOG_DETECTIONS, *msg, plannerClock().toSec());
+    unique_lock<mutex> guard(plannerLock);
+
+    cout << "Received " << msg->blocks.size() << " detections" << endl;
+
+    detectionPending = false;
+
+    int orderedBlocks = workQueue.size();
+    int duplicates = 0;
+
+    for(int i = 0; i < msg->blocks.size(); i++){
+
+        Vector3f blockPos;
+        blockPos << msg->blocks[i].blockPosition.x, msg->blocks[i].blockPosition.y, msg->blocks[i].blockPosition.z;
+        int blockClass = msg->blocks[i].blockClass;
+        float confidence = msg->blocks[i].confidence;
+
+        if(confidence < MIN_CONFIDENCE || !isInWorkspace(blockPos))
+            continue;
+
+        //Blocks already queued, moving or placed are never queued again
+        bool isNew;
+        int id = registry.associate(blockPos, blockClass, msg->blocks[i].blockYaw, confidence, msg->header.stamp.toSec(), isNew);
+        if(registry.get(id).state != BLOCK_ON_TABLE || isQueued(id)){
+            duplicates++;
+            continue;
+        }
+
+        workQueue.push_back(id);
+        traceBlock(id, msg->blocks[i].traceId);
+        markStage(id, STAGE_REQUESTED);
+        markStage(id, STAGE_DETECTED);
+    }
+
+    cout << "Detections of blocks already known: " << duplicates << endl;
+
+    cout << "Blocks in the work queue: " << workQueue.size() << endl;
+
+    if(OPTIMISE_ORDER)
+        reorderWorkQueue(orderedBlocks, guard);
+
+    dispatchIdleArms();
+
+    //Nothing to move and no arm moving, no move result will ask for the next detection
+    if(workQueue.empty() && dispatcher.idle() && !detectionPending){
+        cout << "No block to move, requesting a new detection" << endl;
+        sendDetectionRequest();
+    }
+}
+
+/**
+ * @brief Send the next block of the work queue to the move node of an arm.
+ * The blocks are assigned to the arms by estimated completion time and the arm gets the first block assigned to it.
+ * While assembling a structure the next block is the one of the cheapest ready placement from the arm, the blocks not needed by
+ * the structure are moved to the target area and the ones waiting for their supports stay in the queue
+ * 
+ * @param arm 
+ * @return true if a move order is sent
+ */
+bool dispatchNextBlock(int arm){
+
+    if(workQueue.empty()){
+        cout << "Work queue empty" << endl;
+        return false;
+    }
+
+    if(!assembly.active()){
+        assignWorkQueue();
+        int id = dispatcher.next(arm);
+        if(id < 0){
+            cout << "No block assigned to arm " << arm << endl;
+            return false;
+        }
+        workQueue.erase(find(workQueue.begin(), workQueue.end(), id));
+
+        Placement target = getTargetZone(registry.get(id).blockClass, registry.get(id).position);
+        startMove(arm, id, target.position, target.yaw);
+        return true;
+    }
+
+    //Only the blocks in the pick area of the arm, the others wait for an arm reaching them
+    vector<int> reachable;
+    vector<Vector3f> blockPos;
+    vector<int> blockClass;
+    for(int i = 0; i < workQueue.size(); i++){
+        if(!dispatcher.reaches(arm, registry.get(workQueue[i]).position)) continue;
+        reachable.push_back(i);
+        blockPos.push_back(registry.get(workQueue[i]).position);
+        blockClass.push_back(registry.get(workQueue[i]).blockClass);
+    }
+
+    int element;
+    int selected = assembly.selectPlacement(blockPos, blockClass, homePosition() + dispatcher.arm(arm).baseOffset, element);
+    if(selected >= 0){
+        int id = workQueue[reachable[selected]];
+        workQueue.erase(workQueue.begin() + reachable[selected]);
+
+        cout << "Placing block " << id << " in element " << element << " of the structure" << endl;
+        assembly.startPlacement(element, id);
+        startMove(arm, id, assembly.targetOf(element), assembly.yawOf(element));
+        return true;
+    }
+
+    for(int r = 0; r < reachable.size(); r++){
+        int id = workQueue[reachable[r]];
+        if(!assembly.isNeeded(registry.get(id).blockClass)){
+            workQueue.erase(workQueue.begin() + reachable[r]);
+
+            Placement target = getTargetZone(registry.get(id).blockClass, registry.get(id).position);
+            startMove(arm, id, target.position, target.yaw);
+            return true;
+        }
+    }
+
+    //The queued blocks wait for their supports, they stay in the queue until a support is placed. The blocks in excess of
+    //the elements of their class match no element, they will be detected again
+    cout << "No queued block can be placed in the structure yet" << endl;
+    map<int, int> available;
+    deque<int> waiting;
+    for(int i = 0; i < workQueue.size(); i++){
+        int blockClass = registry.get(workQueue[i]).blockClass;
+        if(!available.count(blockClass)) available[blockClass] = assembly.elementsToDo(blockClass);
+        if(available[blockClass]-- > 0) waiting.push_back(workQueue[i]);
+    }
+    workQueue = waiting;
+    return false;
+}
+
+/**
+ * @brief Send a block to every online arm without a move order, until the work queue is empty
+ * 
+ */
+void dispatchIdleArms(){
+    for(int a = 0; a < dispatcher.arms() && !workQueue.empty(); a++)
+        if(dispatcher.arm(a).blockInTransit < 0 && !dispatcher.arm(a).offline)
+            dispatchNextBlock(a);
+}
+
+/**
+ * @brief Assign the blocks of the work queue to the arms, in the order of the queue, each one to the arm completing it first.
+ * The assignment is recomputed at every dispatch from the estimated end of the orders being executed, so that an arm faster
+ * or slower than estimated takes more or less of the remaining blocks
+ * 
+ */
+void assignWorkQueue(){
+
+    double now = plannerClock().toSec();
+    dispatcher.clearQueues();
+    for(int i = 0; i < workQueue.size(); i++){
+        KnownBlock& block = registry.get(workQueue[i]);
+        dispatcher.assign(workQueue[i], block.position, estimateTargetZone(block.blockClass), now);
+    }
+}
+
+/**
+ * @brief Send a known block to the move node of an arm and mark it as in transit
+ * 
+ * @param arm 
+ * @param id 
+ * @param target 
+ * @param targetYaw yaw of the block at the release
+ */
+void startMove(int arm, int id, Vector3f target, float targetYaw){
+
+    registry.setState(id, BLOCK_IN_TRANSIT);
+    arms[arm].transitTarget = target;
+
+    KnownBlock& block = registry.get(id);
+    dispatcher.started(arm, id, dispatcher.cycleTime(arm, block.position, target), plannerClock().toSec());
+
+    if(dispatcher.arms() > 1)
+        cout << "Block " << id << " assigned to arm " << arm << endl;
+
+    markStage(id, STAGE_ORDERED);
+    sendMoveOrder(arm, block.position, graspYaw(block, block.flippedGrasp), target, targetYaw, id, block.traceId, block.filter.covariance);
+}
+
+/**
+ * @brief World frame yaw of the gripper grasping a block on its short side, the gripper is symmetric so that the block can
+ * be grasped with its yaw or turned by pi
+ * 
+ * @param block 
+ * @param flipped true to turn the gripper by pi
+ * @return float yaw in [-pi, pi]
+ */
+float graspYaw(const KnownBlock& block, bool flipped){
+    return flipped ? remainder(block.yaw + M_PI, 2 * M_PI) : block.yaw;
+}
+
+/**
+ * @brief Check if a block is in the work queue
+ * 
+ * @param id 
+ * @return true 
+ * @return false 
+ */
+bool isQueued(int id){
+    for(int i = 0; i < workQueue.size(); i++)
+        if(workQueue[i] == id) return true;
+    return false;
+}
+
+/**
+ * @brief Reorder the work queue to minimise the estimated time to move all the queued blocks.
+ * Several candidate orders are optimised and simulated in parallel within a deadline, the first one keeps the relative order
+ * of the blocks already ordered, and the fastest feasible one is committed
+ * 
+ * @param orderedBlocks number of blocks at the front of the queue already ordered by a previous call
+ * @param guard lock of the planner state, released while the candidates are simulated
+ */
+void reorderWorkQueue(int orderedBlocks, unique_lock<mutex>& guard){
+
+    PlanningScene scene;
+    vector<int> order;
+    deque<int> plannedQueue = workQueue;
+    int n = plannedQueue.size();
+
+    for(int i = 0; i < n; i++){
+        KnownBlock& block = registry.get(plannedQueue[i]);
+        scene.blockPos.push_back(block.position);
+        scene.blockClass.push_back(block.blockClass);
+        scene.estimatedTargets.push_back(estimateTargetZone(block.blockClass));
+        scene.fallbackTargets.push_back(classSlot(block.blockClass));
+        if(i < orderedBlocks) order.push_back(i);
+    }
+    TargetAllocator allocatorSnapshot = targetAllocator; //the move acks keep allocating while the plans are simulated
+    scene.allocator = PACKED_TARGET_ZONE ? &allocatorSnapshot : NULL;
+    //The first arm starts the queue where its current order ends, it is at the waiting position if idle
+    if(dispatcher.arms() > 0 && dispatcher.arm(0).blockInTransit >= 0)
+        scene.startPos = cycleEnd(arms[0].transitTarget - dispatcher.arm(0).baseOffset);
+    else
+        scene.startPos = homePosition();
+
+    //The gripper closes on the short side of a block with its yaw or with its yaw + pi, the grasps out of reach are left out
+    vector<vector<bool>> graspFlips(n);
+    int graspVariants = 1;
+    for(int i = 0; i < n; i++){
+        KnownBlock& block = registry.get(plannedQueue[i]);
+        Vector3f grasp = block.position;
+        grasp(2) = GRASP_HEIGHT;
+        for(int flip = 0; flip <= 1; flip++)
+            if(isReachable(transformationWorldToBase(grasp), yawWorldToBase(graspYaw(block, flip))))
+                graspFlips[i].push_back(flip);
+        if(graspFlips[i].empty()) graspFlips[i].push_back(block.flippedGrasp);
+        if(graspFlips[i].size() > 1) graspVariants = 2;
+    }
+
+    //Candidates: the current order completed with the new blocks, a new nearest neighbour order and random restarts,
+    //each one with the first and the alternative reachable grasp of every block and with every placement policy allowed
+    vector<CandidatePlan> candidates;
+    mt19937 generator(n);
+    for(int c = 0; c < PLAN_CANDIDATES; c++){
+        CandidatePlan plan;
+        if(c == 0){
+            plan.order = order;
+        }else if(c > 1){
+            plan.order.resize(n);
+            iota(plan.order.begin(), plan.order.end(), 0);
+            shuffle(plan.order.begin(), plan.order.end(), generator);
+        }
+        plan.optimise = true;
+
+        for(int variant = 0; variant < graspVariants; variant++){
+            plan.graspYaw.clear();
+            plan.flippedGrasp.clear();
+            for(int i = 0; i < n; i++){
+                bool flip = graspFlips[i][min(variant, (int)graspFlips[i].size() - 1)];
+                plan.flippedGrasp.push_back(flip);
+                plan.graspYaw.push_back(yawWorldToBase(graspYaw(registry.get(plannedQueue[i]), flip)));
+            }
+
+            for(int rotation = 0; rotation <= ROTATED_PLACEMENT; rotation++){
+                for(int slot = 0; slot <= PACKED_TARGET_ZONE; slot++){
+                    plan.allowRotation = rotation;
+                    plan.nearestSlot = slot;
+                    candidates.push_back(plan);
+                }
+            }
+        }
+    }
+
+    //The simulation works on copies, the move node messages are handled in the meantime
+    guard.unlock();
+    int best = planEvaluator.evaluate(candidates, scene, PLAN_DEADLINE);
+    guard.lock();
+
+    int evaluated = 0;
+    for(int i = 0; i < candidates.size(); i++){
+        if(!candidates[i].evaluated) continue;
+        evaluated++;
+        if(best < 0 || (!candidates[best].feasible && candidates[i].time < candidates[best].time)) best = i;
+    }
+    if(best < 0){
+        cout << "No plan simulated before the deadline, keeping the current order" << endl;
+        return;
+    }
+    if(!candidates[best].feasible)
+        cout << "No feasible plan, some blocks or targets are out of reach" << endl;
+
+    //The current order, completed with the new blocks, is kept unless another plan is faster by more than the model error
+    if(best != 0 && candidates[0].evaluated && candidates[0].feasible && candidates[best].feasible &&
+       candidates[best].time > candidates[0].time - PLAN_MIN_GAIN)
+        best = 0;
+
+    allowRotation = candidates[best].allowRotation;
+    nearestSlot = candidates[best].nearestSlot;
+
+    //Blocks dispatched during the simulation are left out, blocks queued during the simulation keep their place at the end
+    deque<int> orderedQueue;
+    for(int i = 0; i < candidates[best].order.size(); i++){
+        int b = candidates[best].order[i];
+        int id = plannedQueue[b];
+        registry.get(id).flippedGrasp = candidates[best].flippedGrasp[b];
+        if(isQueued(id)) orderedQueue.push_back(id);
+    }
+    for(int i = 0; i < workQueue.size(); i++)
+        if(find(plannedQueue.begin(), plannedQueue.end(), workQueue[i]) == plannedQueue.end())
+            orderedQueue.push_back(workQueue[i]);
+    workQueue = orderedQueue;
+
+    cout << "Estimated time to empty the work queue: " << candidates[best].time << " s (best of " << evaluated << " plans)" << endl;
+}
+
+/**
+ * @brief Publish a detection request to the vision node
+ * 
+ */
+void sendDetectionRequest(){
+
+    std_msgs::Bool msg;
+    msg.data = true;
+    if(DEBUG)cout << "Publishing detection request" << endl;
+    publishWhenConnected(visionPublisher, visionNodeReady(), pendingDetectionRequests, detectionRequestsSince, msg);
+    detectionPending = true;
+    detectionRequestedAt = plannerClock();
 }
 
 /**
@@ -236,16 +1098,148 @@ void visionCallback(const cpp_publisher::BlockInfo::ConstPtr& msg){
  * 
  * @param msg 
  */
-void movementCallback(const cpp_publisher::MoveOperation::ConstPtr& msg){
+void movementCallback(const cpp_publisher::MoveOperationV2::ConstPtr& msg){
+
+    sessionLog.record(LOG_MOVE_RESULT, *msg, plannerClock().toSec());
+    lock_guard<mutex> guard(plannerLock);
 
     cout << "Received movement callback" << endl;
 
-    cout << "Movement result: " << msg->result.data << endl;
+    cout << "Movement result of block " << msg->blockId << " (trace " << hex << msg->traceId << dec << "): " << msg->result
+         << ", received after " << (plannerClock() - msg->header.stamp).toSec() * 1000 << " ms" << endl;
+
+    //Every move node executes one order at a time, the arm of the result is the one moving the block
+    int arm = dispatcher.completed((int)msg->blockId, plannerClock().toSec());
+    int movedBlock = arm >= 0 ? (int)msg->blockId : -1;
+    if(arm < 0)
+        cout << "Result of block " << msg->blockId << " received while no arm is moving it" << endl;
+    bool success = msg->result == "success";
 
-    std_msgs::Bool boolMsg;
-    boolMsg.data = true;
-    visionPublisher.publish(msg->result);
+    if(movedBlock >= 0){
+        if(success){
+            registry.setState(movedBlock, BLOCK_PLACED);
+            registry.moveTo(movedBlock, arms[arm].transitTarget);
+        }else{
+            //The block is still on the table, it is moved again after the blocks already queued
+            registry.setState(movedBlock, BLOCK_ON_TABLE);
+            if(!isQueued(movedBlock)) workQueue.push_back(movedBlock);
+        }
+    }
 
+    if(movedBlock >= 0)
+        metrics.complete(movedBlock, success, plannerClock().toSec());
+
+    if(assembly.active()){
+        assembly.completePlacement(movedBlock, success);
+        if(assembly.complete())
+            cout << "Structure completed" << endl;
+    }
+
+    //Keep emptying the work queue and ask for a new detection pass only once it is empty. The blocks are assigned again,
+    //so an idle arm can get the ones that were waiting for this arm
+    dispatchIdleArms();
+    bool dispatched = arm >= 0 && dispatcher.arm(arm).blockInTransit >= 0;
+
+    if(dispatched)
+        cout << "Blocks left in the work queue: " << workQueue.size() << endl;
+    else if(BATCH_DETECTION && PIPELINED_DETECTION && detectionPending)
+        cout << "Waiting for the detection requested during the movement" << endl;
+    else
+        sendDetectionRequest();
+
+}
+
+/**
+ * @brief Callback for move node which receives the stage reached by the movement.
+ * Once the arm is out of the camera view the next detection is requested, so that it is ready when the arm comes back
+ * 
+ * @param msg 
+ */
+void progressCallback(const cpp_publisher::MoveOperationV2::ConstPtr& msg){
+
+    sessionLog.record(LOG_MOVE_PROGRESS, *msg, plannerClock().toSec());
+    lock_guard<mutex> guard(plannerLock);
+
+    if(DEBUG)cout << "Block " << msg->blockId << " (trace " << hex << msg->traceId << dec << ") reached " << msg->result << endl;
+
+    //Stages of an order sent before a restart of the planner are not recorded
+    int id = dispatcher.armOf((int)msg->blockId) >= 0 ? (int)msg->blockId : -1;
+    if(msg->result == "started") markStage(id, STAGE_STARTED);
+    else if(msg->result == "grasped") markStage(id, STAGE_GRASPED);
+    else if(msg->result == "placed") markStage(id, STAGE_PLACED);
+
+    if(msg->result != "left check point")
+        return;
+
+    if(BATCH_DETECTION && PIPELINED_DETECTION && workQueue.empty() && !detectionPending){
+        cout << "Requesting the next detection while moving" << endl;
+        sendDetectionRequest();
+    }
+}
+
+/**
+ * @brief Start a trace for a detection received without one. The high half is the process id of the planner,
+ * so that its traces do not collide with the ones of the vision node, which starts from a random session
+ * 
+ * @return uint64_t 
+ */
+uint64_t newTraceId(){
+    return ((uint64_t)getpid() << 32) | ++traceCounter;
+}
+
+/**
+ * @brief Attach to a block the trace of its first detection, the later detections of the block keep it
+ * 
+ * @param id 
+ * @param traceId trace of the detection, 0 to start a new one
+ */
+void traceBlock(int id, uint64_t traceId){
+    KnownBlock& block = registry.get(id);
+    if(block.traceId != 0) return;
+    block.traceId = traceId != 0 ? traceId : newTraceId();
+}
+
+/**
+ * @brief Record the time a block reaches a stage, the request time is the one of the last detection request
+ * 
+ * @param id 
+ * @param stage 
+ */
+void markStage(int id, BlockStage stage){
+
+    if(id < 0) return;
+
+    if(stage == STAGE_REQUESTED)
+        metrics.mark(id, stage, detectionRequestedAt.toSec());
+    else
+        metrics.mark(id, stage, plannerClock().toSec());
 }
 
+/**
+ * @brief Publish the throughput and the latency percentiles of the blocks placed in the rolling window, and log a summary
+ * 
+ * @param event 
+ */
+void publishMetrics(const ros::TimerEvent& event){
+
+    lock_guard<mutex> guard(plannerLock);
+    MetricsSummary summary = metrics.summary(plannerClock().toSec());
 
+    cpp_publisher::CellMetrics msg;
+    msg.header.stamp = plannerClock();
+    msg.blocksPerMinute = summary.blocksPerMinute;
+    msg.blocksPlaced = summary.blocksPlaced;
+    msg.blocksFailed = summary.blocksFailed;
+    msg.intervals = summary.intervals;
+    msg.p50 = summary.p50;
+    msg.p90 = summary.p90;
+    msg.p99 = summary.p99;
+    metricsPublisher.publish(msg);
+
+    cout << "Throughput: " << summary.blocksPerMinute << " blocks/min, placed " << summary.blocksPlaced << ", failed " << summary.blocksFailed << endl;
+    for(int i = 0; i < summary.intervals.size(); i++)
+        cout << "  " << summary.intervals[i] << ": p50 " << summary.p50[i] << " s, p90 " << summary.p90[i] << " s, p99 " << summary.p99[i] << " s" << endl;
+    for(int a = 0; a < dispatcher.arms() && dispatcher.arms() > 1; a++)
+        cout << "  arm " << a << " '" << arms[a].ns << "': " << dispatcher.arm(a).completed << " orders completed, "
+             << dispatcher.arm(a).queue.size() << " blocks assigned" << endl;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file plannerNodelet.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the planner node packaged as a nodelet
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * Loaded in the same nodelet manager as the move node, the move orders and the move results are passed as shared
+ * pointers without serialisation. The planner source is included without its main function.
+ */
+
+#define PLANNER_NODELET
+#include "planner.cpp"
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+namespace cpp_publisher{
+
+/**
+ * @brief Nodelet running the planner
+ *
+ */
+class PlannerNodelet : public nodelet::Nodelet{
+private:
+    /**
+     * @brief Set up the planner and ask for the first detection. The timers run on the nodelet manager threads,
+     * the vision and move callbacks on the threads of the planner
+     *
+     */
+    virtual void onInit(){
+        setupPlanner(getNodeHandle(), getPrivateNodeHandle());
+        lock_guard<mutex> guard(plannerLock);
+        sendDetectionRequest();
+    }
+};
+
+}
+
+PLUGINLIB_EXPORT_CLASS(cpp_publisher::PlannerNodelet, nodelet::Nodelet)
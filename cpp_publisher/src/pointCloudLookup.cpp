@@ -0,0 +1,188 @@
+/**
+ * @file pointCloudLookup.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the direct lookup of the points of an organized point cloud by pixel
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The point cloud of the ZED camera is organized: the point of the pixel (u, v) of the image is at the byte offset
+ * v * row_step + u * point_step of the data, plus the offset of each field. The offsets of the fields are found once
+ * per cloud, then every pixel is read with a single copy, without iterating over the cloud.
+ * The points are moved from the camera frame to the world frame with the transformation and calibration of the camera
+ * read from the /camera parameters, loaded from config/camera.yaml and shared with the vision node.
+ */
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+
+using namespace std;
+using Eigen::Vector3f;
+using Eigen::Matrix3f;
+
+/**
+ * @brief Struct to store the configuration of the camera, of the simulation or of the real robot
+ *
+ */
+struct CameraConfig{
+    bool realRobot;
+    Matrix3f rotation; // camera frame to world frame
+    Vector3f offset; // offset of the camera and of the base
+    Vector3f correction; // calibration fixing
+    int cropWidth, cropHeight; // pixels cropped from the left and the top of the image, out of the table
+    float minZ, maxZ; // height of the blocks on the table [m]
+};
+
+///Configuration of the camera, read by loadCameraConfig
+CameraConfig camera;
+
+/**
+ * @brief Read the configuration of the camera from the /camera parameters, the same read by the vision node
+ *
+ * @param node
+ * @return true if every parameter is set
+ */
+bool loadCameraConfig(const ros::NodeHandle& node){
+
+    if(!node.getParam("/camera/real_robot", camera.realRobot)){
+        cout << "Camera configuration not found, load it with: rosparam load $(rospack find cpp_publisher)/config/camera.yaml /camera" << endl;
+        return false;
+    }
+
+    string ns = camera.realRobot ? "/camera/real/" : "/camera/simulation/";
+    vector<double> rotation, cameraOffset, baseOffset, correction, zLimits;
+    vector<int> crop;
+    if(!node.getParam(ns + "rotation", rotation) || rotation.size() != 9 || !node.getParam(ns + "camera_offset", cameraOffset) || cameraOffset.size() != 3 ||
+       !node.getParam(ns + "base_offset", baseOffset) || baseOffset.size() != 3 || !node.getParam(ns + "correction", correction) || correction.size() != 3 ||
+       !node.getParam(ns + "crop", crop) || crop.size() != 2 || !node.getParam(ns + "z_limits", zLimits) || zLimits.size() != 2){
+        cout << "Incomplete camera configuration in " << ns << endl;
+        return false;
+    }
+
+    for(int i = 0; i < 3; i++){
+        for(int j = 0; j < 3; j++)
+            camera.rotation(i, j) = rotation[3 * i + j];
+        camera.offset(i) = cameraOffset[i] + baseOffset[i];
+        camera.correction(i) = correction[i];
+    }
+    camera.cropWidth = crop[0];
+    camera.cropHeight = crop[1];
+    camera.minZ = zLimits[0];
+    camera.maxZ = zLimits[1];
+
+    cout << "Camera of the " << (camera.realRobot ? "real robot" : "simulation") << endl;
+    return true;
+}
+
+/**
+ * @brief Struct to store the byte offsets of the coordinates in a point of the cloud
+ *
+ */
+struct CloudLayout{
+    int x, y, z; // -1 if the field is missing
+    bool valid; // true if the three fields are float32 and the cloud has the byte order of the host
+};
+
+/**
+ * @brief Find the offsets of the x, y and z fields of a point cloud
+ *
+ * @param cloud
+ * @return CloudLayout
+ */
+CloudLayout cloudLayout(const sensor_msgs::PointCloud2& cloud){
+
+    CloudLayout layout = {-1, -1, -1, false};
+    bool float32 = true;
+
+    for(int i = 0; i < cloud.fields.size(); i++){
+        const sensor_msgs::PointField& field = cloud.fields[i];
+        int* offset = field.name == "x" ? &layout.x : field.name == "y" ? &layout.y : field.name == "z" ? &layout.z : NULL;
+        if(!offset) continue;
+        *offset = field.offset;
+        if(field.datatype != sensor_msgs::PointField::FLOAT32) float32 = false;
+    }
+
+    layout.valid = float32 && !cloud.is_bigendian && layout.x >= 0 && layout.y >= 0 && layout.z >= 0 &&
+                   max(layout.x, max(layout.y, layout.z)) + sizeof(float) <= cloud.point_step;
+    return layout;
+}
+
+/**
+ * @brief Read the point of a pixel of an organized point cloud, in the camera frame
+ *
+ * @param cloud
+ * @param layout offsets of the fields, from cloudLayout
+ * @param u column of the pixel
+ * @param v row of the pixel
+ * @param point
+ * @return true if the pixel is in the cloud and its point is not NaN
+ */
+bool cloudPoint(const sensor_msgs::PointCloud2& cloud, const CloudLayout& layout, int u, int v, Vector3f& point){
+
+    if(!layout.valid || u < 0 || v < 0 || u >= cloud.width || v >= cloud.height)
+        return false;
+
+    size_t offset = (size_t)v * cloud.row_step + (size_t)u * cloud.point_step;
+    if(offset + cloud.point_step > cloud.data.size())
+        return false;
+
+    const uint8_t* data = &cloud.data[offset];
+    float x, y, z;
+    memcpy(&x, data + layout.x, sizeof(float));
+    memcpy(&y, data + layout.y, sizeof(float));
+    memcpy(&z, data + layout.z, sizeof(float));
+
+    point << x, y, z;
+    return !isnan(x) && !isnan(y) && !isnan(z);
+}
+
+/**
+ * @brief Move a point from the camera frame to the world frame, with the calibration of the camera
+ *
+ * @param pointInCamera
+ * @return Vector3f
+ */
+Vector3f cameraToWorld(Vector3f pointInCamera){
+    return camera.rotation * pointInCamera + camera.offset + camera.correction;
+}
+
+/**
+ * @brief Look up the world frame points of a batch of pixels in one pass over the pixels
+ *
+ * @param cloud
+ * @param u columns of the pixels
+ * @param v rows of the pixels
+ * @param points world frame point of every pixel, zero if not valid
+ * @param valid true for the pixels with a point
+ * @return int number of valid points
+ */
+int lookupPixels(const sensor_msgs::PointCloud2& cloud, const vector<int>& u, const vector<int>& v, vector<Vector3f>& points, vector<bool>& valid){
+
+    int n = min(u.size(), v.size());
+    points.assign(n, Vector3f::Zero());
+    valid.assign(n, false);
+
+    CloudLayout layout = cloudLayout(cloud);
+    if(!layout.valid){
+        cout << "Point cloud without float32 x, y, z fields in the byte order of the host" << endl;
+        return 0;
+    }
+
+    int count = 0;
+    for(int i = 0; i < n; i++){
+        Vector3f point;
+        if(!cloudPoint(cloud, layout, u[i], v[i], point)) continue;
+        points[i] = cameraToWorld(point);
+        valid[i] = true;
+        count++;
+    }
+
+    return count;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file pointLookup.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the node looking up the world frame position of the pixels of the detections in the point cloud
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The node keeps the last point clouds of the ZED camera and answers the vision node with the world frame points of all
+ * the detections of a frame in a single service call. The cloud is deserialised once, in C++, and every pixel is read
+ * directly at its offset, instead of iterating over the cloud in Python once per block.
+ */
+
+#include <iostream>
+#include <deque>
+#include <mutex>
+#include <chrono>
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <cpp_publisher/PointLookup.h> // Service with the pixels of the detections and their world frame points
+
+#include "pointCloudLookup.cpp" // Direct lookup of the points of an organized point cloud
+
+///Set to 1 to log the time of every lookup
+#define DEBUG 0
+///Number of point clouds kept, the vision node asks for the one of the frame it is processing
+#define CLOUD_HISTORY 4
+
+using namespace std;
+
+///Last point clouds received, the newest at the back
+deque<sensor_msgs::PointCloud2::ConstPtr> clouds;
+///Lock of the point clouds, the subscriber and the service run on different threads
+mutex cloudLock;
+
+void cloudCallback(const sensor_msgs::PointCloud2::ConstPtr& cloud); // Keep a point cloud
+bool lookupCallback(cpp_publisher::PointLookup::Request& request, cpp_publisher::PointLookup::Response& response); // Look up the pixels of a frame
+
+int main(int argc, char **argv){
+
+    ros::init(argc, argv, "point_lookup");
+    ros::NodeHandle node;
+
+    if(!loadCameraConfig(node))
+        return 1;
+
+    ros::Subscriber cloudSubscriber = node.subscribe("/ur5/zed_node/point_cloud/cloud_registered", 1, cloudCallback, ros::TransportHints().tcpNoDelay());
+    ros::ServiceServer lookupServer = node.advertiseService("/vision/point_lookup", lookupCallback);
+
+    //A lookup does not wait for the next cloud to be deserialised
+    ros::AsyncSpinner spinner(2);
+    spinner.start();
+
+    cout << "Point lookup ready" << endl;
+    ros::waitForShutdown();
+
+    return 0;
+}
+
+/**
+ * @brief Keep a point cloud, dropping the oldest one
+ *
+ * @param cloud
+ */
+void cloudCallback(const sensor_msgs::PointCloud2::ConstPtr& cloud){
+    lock_guard<mutex> guard(cloudLock);
+    clouds.push_back(cloud);
+    if(clouds.size() > CLOUD_HISTORY)
+        clouds.pop_front();
+}
+
+/**
+ * @brief Look up the world frame points of the pixels of a frame in the point cloud with its stamp, or in the nearest one
+ *
+ * @param request
+ * @param response
+ * @return true if a point cloud was received
+ */
+bool lookupCallback(cpp_publisher::PointLookup::Request& request, cpp_publisher::PointLookup::Response& response){
+
+    auto start = chrono::steady_clock::now();
+
+    sensor_msgs::PointCloud2::ConstPtr cloud;
+    {
+        lock_guard<mutex> guard(cloudLock);
+        for(int i = 0; i < clouds.size(); i++)
+            if(!cloud || fabs((clouds[i]->header.stamp - request.stamp).toSec()) < fabs((cloud->header.stamp - request.stamp).toSec()))
+                cloud = clouds[i];
+    }
+    if(!cloud){
+        cout << "No point cloud received yet" << endl;
+        return false;
+    }
+
+    vector<int> u(request.u.begin(), request.u.end()), v(request.v.begin(), request.v.end());
+    vector<Vector3f> points;
+    vector<bool> valid;
+    int found = lookupPixels(*cloud, u, v, points, valid);
+
+    response.points.resize(points.size());
+    response.valid.resize(points.size());
+    for(int i = 0; i < points.size(); i++){
+        response.points[i].x = points[i](0);
+        response.points[i].y = points[i](1);
+        response.points[i].z = points[i](2);
+        response.valid[i] = valid[i];
+    }
+    response.cloudStamp = cloud->header.stamp;
+
+    if(DEBUG)
+        cout << "Looked up " << found << "/" << points.size() << " pixels in "
+             << chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1e6 << " us" << endl;
+
+    return true;
+}
@@ -0,0 +1,477 @@
+/**
+ * @file poseEstimation.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the estimation of the 6 DoF pose of a block by registration of its points on the STL model
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The surface of the STL model of every class is sampled once into points with their normals, indexed by a k-d tree.
+ * The points of a block segmented from the point cloud are registered on the model with point to plane ICP, with a small
+ * point to point term that keeps the block from sliding on its faces. The registration starts from the principal axes of
+ * the points: the axes of the model are matched to them in each of the 24 ways of turning a box, with the model resting on
+ * the table, so that a block upside down or lying on a side is found like an upright one. The start with the most points
+ * on the model after a few iterations is refined until convergence. The starts giving the model a height far from the one
+ * of the block over the table are skipped.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+using namespace std;
+using Eigen::Vector3f;
+using Eigen::Matrix3f;
+
+///Spacing of the points sampled on the surface of the models [m]
+#define MODEL_SPACING 0.003
+///Maximum number of points of a block registered from every start and in the refinement
+#define COARSE_POINTS 80
+#define REGISTRATION_POINTS 200
+///Maximum difference between the height of the block and the height of the model from a start [m]
+#define HEIGHT_TOLERANCE 0.012
+///Iterations of ICP from every start and of the refinement of the best one
+#define COARSE_ITERATIONS 6
+#define FINE_ITERATIONS 20
+///Maximum distance of a point of the block from the model in the coarse and in the fine iterations [m]
+#define COARSE_DISTANCE 0.02
+#define FINE_DISTANCE 0.006
+///Distance of a point of the block from the model to be counted as fitting [m]
+#define FIT_DISTANCE 0.003
+///Weight of the point to point term of ICP
+#define POINT_TO_POINT_WEIGHT 0.05
+///Minimum fraction of the points of the block fitting the model for a valid pose
+#define MIN_POSE_FITNESS 0.6
+
+///Name of the STL model of each block class
+const char* BLOCK_MODEL_NAMES[] = {"X1-Y1-Z2", "X1-Y2-Z1", "X1-Y2-Z2", "X1-Y2-Z2-CHAMFER", "X1-Y2-Z2-TWINFILLET", "X1-Y3-Z2",
+                                   "X1-Y3-Z2-FILLET", "X1-Y4-Z1", "X1-Y4-Z2", "X2-Y2-Z2", "X2-Y2-Z2-FILLET"};
+///Number of block classes with a model
+#define MODEL_CLASSES 11
+
+/**
+ * @brief k-d tree of a set of 3D points, for the nearest neighbour queries of ICP
+ *
+ */
+class KdTree{
+public:
+    void build(const vector<Vector3f>& points); // Index a set of points
+    int nearest(const Vector3f& query, float& distance2, float maxDistance2 = INFINITY) const; // Index of the point nearest to a query
+
+private:
+    struct Node{
+        int point; // index of the point splitting the node
+        int axis;
+        int left, right; // children, -1 if none
+    };
+    vector<Vector3f> points;
+    vector<Node> nodes;
+    int root;
+
+    int build(vector<int>& indices, int begin, int end, int depth); // Build the subtree of a range of points
+    void search(int node, const Vector3f& query, int& best, float& bestDistance2) const; // Search a subtree
+};
+
+/**
+ * @brief Index a set of points, splitting them at the median of the axes in turn
+ *
+ * @param points
+ */
+void KdTree::build(const vector<Vector3f>& points){
+    this->points = points;
+    nodes.clear();
+    nodes.reserve(points.size());
+    vector<int> indices(points.size());
+    for(int i = 0; i < indices.size(); i++) indices[i] = i;
+    root = build(indices, 0, indices.size(), 0);
+}
+
+/**
+ * @brief Build the subtree of a range of points
+ *
+ * @param indices indices of the points, reordered
+ * @param begin
+ * @param end excluded
+ * @param depth
+ * @return int index of the root of the subtree, -1 if the range is empty
+ */
+int KdTree::build(vector<int>& indices, int begin, int end, int depth){
+
+    if(begin >= end) return -1;
+
+    int axis = depth % 3;
+    int middle = (begin + end) / 2;
+    nth_element(indices.begin() + begin, indices.begin() + middle, indices.begin() + end,
+                [this, axis](int a, int b){ return points[a](axis) < points[b](axis); });
+
+    int node = nodes.size();
+    nodes.push_back({indices[middle], axis, -1, -1});
+    int left = build(indices, begin, middle, depth + 1);
+    int right = build(indices, middle + 1, end, depth + 1);
+    nodes[node].left = left;
+    nodes[node].right = right;
+    return node;
+}
+
+/**
+ * @brief Search the nearest point in a subtree, the far side of a split is visited only if it can hold a nearer point
+ *
+ * @param node
+ * @param query
+ * @param best index of the nearest point found
+ * @param bestDistance2 its squared distance
+ */
+void KdTree::search(int node, const Vector3f& query, int& best, float& bestDistance2) const{
+
+    if(node < 0) return;
+    const Node& current = nodes[node];
+
+    float distance2 = (points[current.point] - query).squaredNorm();
+    if(distance2 < bestDistance2){
+        bestDistance2 = distance2;
+        best = current.point;
+    }
+
+    float split = query(current.axis) - points[current.point](current.axis);
+    search(split < 0 ? current.left : current.right, query, best, bestDistance2);
+    if(split * split < bestDistance2)
+        search(split < 0 ? current.right : current.left, query, best, bestDistance2);
+}
+
+/**
+ * @brief Index of the point nearest to a query
+ *
+ * @param query
+ * @param distance2 squared distance of the nearest point
+ * @param maxDistance2 squared distance beyond which the points are not searched
+ * @return int -1 if no point is nearer than the maximum distance
+ */
+int KdTree::nearest(const Vector3f& query, float& distance2, float maxDistance2) const{
+    int best = -1;
+    distance2 = maxDistance2;
+    search(root, query, best, distance2);
+    return best;
+}
+
+/**
+ * @brief Struct to store the model of a block class: points sampled on its surface with their normals
+ *
+ */
+struct BlockModel{
+    bool loaded;
+    vector<Vector3f> points, normals; // model frame, origin at the center of the bottom face
+    Vector3f centroid;
+    Vector3f boxMin, boxMax; // bounding box in the model frame
+    KdTree tree;
+};
+
+/**
+ * @brief Struct to store the pose of a block
+ *
+ */
+struct BlockPose{
+    bool valid;
+    Matrix3f rotation; // from the model frame to the world frame
+    Vector3f position; // origin of the model in the world frame
+    float fitness; // fraction of the points of the block fitting the model
+    float rms; // distance of the fitting points from the model [m]
+};
+
+/**
+ * @brief Load a binary STL model and sample its surface every MODEL_SPACING, with the normal of each point
+ *
+ * @param path
+ * @param model
+ * @return true if the file was read
+ */
+bool loadBlockModel(const string& path, BlockModel& model){
+
+    model.loaded = false;
+    ifstream file(path, ios::binary);
+    if(!file){
+        cout << "Model " << path << " not found" << endl;
+        return false;
+    }
+
+    char header[80];
+    uint32_t triangles = 0;
+    file.read(header, 80);
+    file.read((char*)&triangles, sizeof(triangles));
+    if(!file || (string(header, 5) == "solid" && triangles == 0)){
+        cout << "Model " << path << " is not a binary STL" << endl;
+        return false;
+    }
+
+    model.points.clear();
+    model.normals.clear();
+    for(uint32_t t = 0; t < triangles; t++){
+        float data[12];
+        uint16_t attributes;
+        file.read((char*)data, sizeof(data));
+        file.read((char*)&attributes, sizeof(attributes));
+        if(!file){
+            cout << "Model " << path << " truncated" << endl;
+            return false;
+        }
+
+        Vector3f a(data[3], data[4], data[5]), b(data[6], data[7], data[8]), c(data[9], data[10], data[11]);
+        Vector3f normal = (b - a).cross(c - a);
+        float area = normal.norm() / 2;
+        if(area < 1e-12) continue;
+        normal.normalize();
+
+        //Centers of the cells of a triangular grid on the triangle, at least one per triangle
+        int divisions = max(1, (int)ceil(sqrt(2 * area) / MODEL_SPACING));
+        for(int i = 0; i < divisions; i++)
+            for(int j = 0; i + j < divisions; j++){
+                float u = (i + 1.f / 3) / divisions, v = (j + 1.f / 3) / divisions;
+                model.points.push_back(a + u * (b - a) + v * (c - a));
+                model.normals.push_back(normal);
+            }
+    }
+
+    if(model.points.empty()) return false;
+
+    model.centroid = Vector3f::Zero();
+    model.boxMin = model.boxMax = model.points[0];
+    for(int i = 0; i < model.points.size(); i++){
+        model.centroid += model.points[i];
+        model.boxMin = model.boxMin.cwiseMin(model.points[i]);
+        model.boxMax = model.boxMax.cwiseMax(model.points[i]);
+    }
+    model.centroid /= model.points.size();
+    model.tree.build(model.points);
+    model.loaded = true;
+    return true;
+}
+
+/**
+ * @brief Register the points of a block on a model with point to plane ICP. The pose moves the model to the world, the
+ * registration moves the points of the block to the model, with the inverse of the pose
+ *
+ * @param model
+ * @param scan points of the block in the world frame
+ * @param rotation pose of the model, start and result
+ * @param position
+ * @param iterations
+ * @param maxDistance maximum distance of a correspondence [m]
+ * @param fitness fraction of the points within FIT_DISTANCE of the model
+ * @return float distance of the fitting points from the model [m]
+ */
+float registerBlock(const BlockModel& model, const vector<Vector3f>& scan, Matrix3f& rotation, Vector3f& position,
+                    int iterations, float maxDistance, float& fitness){
+
+    Matrix3f inverseRotation = rotation.transpose();
+    Vector3f inverseTranslation = -inverseRotation * position;
+    typedef Eigen::Matrix<float, 6, 6> Matrix6f;
+    typedef Eigen::Matrix<float, 6, 1> Vector6f;
+
+    for(int iteration = 0; iteration < iterations; iteration++){
+        Matrix6f A = Matrix6f::Zero();
+        Vector6f b = Vector6f::Zero();
+        int correspondences = 0;
+
+        for(int i = 0; i < scan.size(); i++){
+            Vector3f q = inverseRotation * scan[i] + inverseTranslation;
+            float distance2;
+            int nearest = model.tree.nearest(q, distance2, maxDistance * maxDistance);
+            if(nearest < 0) continue;
+
+            const Vector3f& m = model.points[nearest];
+            const Vector3f& n = model.normals[nearest];
+
+            //Point to plane: n.(q + w x q + dt - m)
+            Vector6f J;
+            J << q.cross(n), n;
+            float r = n.dot(q - m);
+            A += J * J.transpose();
+            b -= J * r;
+
+            //Point to point: q + w x q + dt - m
+            Matrix3f Q;
+            Q << 0, -q(2), q(1),
+                 q(2), 0, -q(0),
+                 -q(1), q(0), 0;
+            Eigen::Matrix<float, 3, 6> P;
+            P << -Q, Matrix3f::Identity();
+            A += POINT_TO_POINT_WEIGHT * P.transpose() * P;
+            b -= POINT_TO_POINT_WEIGHT * P.transpose() * (q - m);
+
+            correspondences++;
+        }
+
+        if(correspondences < 6) break;
+
+        Vector6f x = A.ldlt().solve(b);
+        if(!x.allFinite()) break;
+        Vector3f w = x.head<3>();
+        Matrix3f step = w.norm() > 1e-9 ? Eigen::AngleAxisf(w.norm(), w.normalized()).toRotationMatrix() : Matrix3f::Identity();
+        inverseRotation = step * inverseRotation;
+        inverseTranslation = step * inverseTranslation + x.tail<3>();
+
+        if(x.norm() < 1e-5) break;
+    }
+
+    rotation = inverseRotation.transpose();
+    position = -rotation * inverseTranslation;
+
+    //Fit of the final pose
+    int fitting = 0;
+    float squared = 0;
+    for(int i = 0; i < scan.size(); i++){
+        float distance2;
+        if(model.tree.nearest(inverseRotation * scan[i] + inverseTranslation, distance2, FIT_DISTANCE * FIT_DISTANCE) < 0) continue;
+        fitting++;
+        squared += distance2;
+    }
+    fitness = scan.empty() ? 0 : (float)fitting / scan.size();
+    return fitting > 0 ? sqrt(squared / fitting) : INFINITY;
+}
+
+/**
+ * @brief Estimator of the pose of the blocks, holding the model of every class
+ *
+ */
+class PoseEstimator{
+public:
+    int loadModels(const string& directory); // Load the STL model of every class
+    bool hasModel(int blockClass) const; // True if the model of a class is loaded
+    BlockPose estimate(int blockClass, const vector<Vector3f>& points, Vector3f tableNormal, float tableOffset) const; // Pose of a block
+
+private:
+    BlockModel models[MODEL_CLASSES];
+};
+
+/**
+ * @brief Load the STL model of every class from a directory
+ *
+ * @param directory
+ * @return int number of models loaded
+ */
+int PoseEstimator::loadModels(const string& directory){
+    int loaded = 0;
+    for(int c = 0; c < MODEL_CLASSES; c++)
+        if(loadBlockModel(directory + "/" + BLOCK_MODEL_NAMES[c] + ".stl", models[c])) loaded++;
+    return loaded;
+}
+
+/**
+ * @brief True if the model of a class is loaded
+ *
+ * @param blockClass
+ * @return bool
+ */
+bool PoseEstimator::hasModel(int blockClass) const{
+    return blockClass >= 0 && blockClass < MODEL_CLASSES && models[blockClass].loaded;
+}
+
+/**
+ * @brief Estimate the pose of a block from its points: ICP from the 24 ways of matching the axes of the model to the
+ * principal axes of the points, the model resting on the table, and refinement of the best start
+ *
+ * @param blockClass
+ * @param points points of the block in the world frame
+ * @param tableNormal normal of the table, pointing up
+ * @param tableOffset the points of the table have tableNormal.dot(p) + tableOffset = 0
+ * @return BlockPose
+ */
+BlockPose PoseEstimator::estimate(int blockClass, const vector<Vector3f>& points, Vector3f tableNormal, float tableOffset) const{
+
+    BlockPose pose;
+    pose.valid = false;
+    pose.fitness = 0;
+    pose.rms = INFINITY;
+    if(!hasModel(blockClass) || points.size() < 6) return pose;
+    const BlockModel& model = models[blockClass];
+
+    //Evenly spaced subsets of the points
+    vector<Vector3f> scan, coarse;
+    int step = max(1, (int)points.size() / REGISTRATION_POINTS);
+    for(int i = 0; i < points.size(); i += step) scan.push_back(points[i]);
+    step = max(1, (int)scan.size() / COARSE_POINTS);
+    for(int i = 0; i < scan.size(); i += step) coarse.push_back(scan[i]);
+
+    float height = 0;
+    for(int i = 0; i < scan.size(); i++) height = max(height, tableNormal.dot(scan[i]) + tableOffset);
+
+    Vector3f centroid = Vector3f::Zero();
+    for(int i = 0; i < scan.size(); i++) centroid += scan[i];
+    centroid /= scan.size();
+
+    Matrix3f covariance = Matrix3f::Zero();
+    for(int i = 0; i < scan.size(); i++){
+        Vector3f d = scan[i] - centroid;
+        covariance += d * d.transpose();
+    }
+
+    //Principal axes, the major first, in a right handed frame with the third axis up
+    Eigen::SelfAdjointEigenSolver<Matrix3f> solver(covariance);
+    Vector3f major = solver.eigenvectors().col(2);
+    Vector3f up = tableNormal.normalized();
+    major = (major - major.dot(up) * up);
+    if(major.norm() < 1e-6) major = up.unitOrthogonal();
+    major.normalize();
+    Matrix3f axes;
+    axes << major, up.cross(major), up;
+
+    //The 24 rotations of a box: every axis of the model on the first axis, four turns around it
+    vector<Matrix3f> starts;
+    for(int first = 0; first < 6; first++){
+        Vector3f a = Vector3f::Zero();
+        a(first / 2) = first % 2 ? -1 : 1;
+        for(int second = 0; second < 6; second++){
+            Vector3f b = Vector3f::Zero();
+            b(second / 2) = second % 2 ? -1 : 1;
+            if(fabs(a.dot(b)) > 0.5) continue;
+            Matrix3f turn;
+            turn << a.transpose(), b.transpose(), a.cross(b).transpose();
+            starts.push_back(axes * turn);
+        }
+    }
+
+    Vector3f corners[8];
+    for(int k = 0; k < 8; k++)
+        corners[k] << (k & 1 ? model.boxMax(0) : model.boxMin(0)), (k & 2 ? model.boxMax(1) : model.boxMin(1)), (k & 4 ? model.boxMax(2) : model.boxMin(2));
+
+    float bestFitness = -1, bestRms = INFINITY;
+    Matrix3f bestRotation;
+    Vector3f bestPosition;
+    for(int s = 0; s < starts.size(); s++){
+        Matrix3f rotation = starts[s];
+        Vector3f position = centroid - rotation * model.centroid;
+
+        //The lowest corner of the model on the table
+        float lowest = INFINITY, highest = -INFINITY;
+        for(int k = 0; k < 8; k++){
+            float corner = tableNormal.dot(rotation * corners[k] + position) + tableOffset;
+            lowest = min(lowest, corner);
+            highest = max(highest, corner);
+        }
+        if(fabs(highest - lowest - height) > HEIGHT_TOLERANCE) continue;
+        position -= lowest * tableNormal;
+
+        float fitness;
+        float rms = registerBlock(model, coarse, rotation, position, COARSE_ITERATIONS, COARSE_DISTANCE, fitness);
+        if(fitness > bestFitness + 1e-3 || (fabs(fitness - bestFitness) <= 1e-3 && rms < bestRms)){
+            bestFitness = fitness;
+            bestRms = rms;
+            bestRotation = rotation;
+            bestPosition = position;
+        }
+    }
+
+    if(bestFitness < 0) return pose;
+
+    pose.rotation = bestRotation;
+    pose.position = bestPosition;
+    pose.rms = registerBlock(model, scan, pose.rotation, pose.position, FINE_ITERATIONS, FINE_DISTANCE, pose.fitness);
+    pose.valid = pose.fitness >= MIN_POSE_FITNESS;
+    return pose;
+}
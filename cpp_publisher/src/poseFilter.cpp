@@ -0,0 +1,105 @@
+/**
+ * @file poseFilter.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the filter fusing the successive detections of a block in a position estimate with its covariance
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The blocks on the table are static, so the filter is a Kalman filter with identity dynamics and a small process noise
+ * that lets the estimate follow a block nudged by the arm. Detections too far from the estimate are rejected as outliers,
+ * unless they keep coming: then the block has really moved and the filter restarts from the new detection.
+ */
+
+#include <iostream>
+#include <Eigen/Dense>
+#include <cmath>
+
+using namespace std;
+using Eigen::Vector3f;
+using Eigen::Matrix3f;
+
+///Standard deviation of a detection on the table plane with confidence 1 [m]
+#define DETECTION_SIGMA_XY 0.01
+///Standard deviation of a detection along z with confidence 1 [m]
+#define DETECTION_SIGMA_Z 0.005
+///Standard deviation of the movement of a block between two detections [m]
+#define PROCESS_SIGMA 0.001
+///Squared Mahalanobis distance over which a detection is an outlier (chi-square with 3 dof, 99.9%)
+#define OUTLIER_THRESHOLD 16.27
+///Consecutive outliers after which the filter restarts from the last detection
+#define MAX_OUTLIERS 2
+
+/**
+ * @brief Struct to store the position estimate of a block
+ *
+ */
+struct PositionFilter{
+    Vector3f mean; // world frame position
+    Matrix3f covariance;
+    int outliers; // consecutive detections rejected
+};
+
+Matrix3f detectionNoise(float confidence); // Covariance of a detection given its confidence
+void initFilter(PositionFilter& filter, Vector3f measurement, Matrix3f noise); // Start the estimate from a detection
+bool fuseDetection(PositionFilter& filter, Vector3f measurement, Matrix3f noise); // Fuse a detection in the estimate
+
+/**
+ * @brief Covariance of a detection, the lower the confidence of the detector the larger the covariance
+ *
+ * @param confidence
+ * @return Matrix3f
+ */
+Matrix3f detectionNoise(float confidence){
+    float scale = 1.0 / max(confidence, 0.05f);
+    Matrix3f noise = Matrix3f::Zero();
+    noise(0,0) = noise(1,1) = pow(DETECTION_SIGMA_XY, 2) * scale;
+    noise(2,2) = pow(DETECTION_SIGMA_Z, 2) * scale;
+    return noise;
+}
+
+/**
+ * @brief Start the estimate from a detection
+ *
+ * @param filter
+ * @param measurement
+ * @param noise
+ */
+void initFilter(PositionFilter& filter, Vector3f measurement, Matrix3f noise){
+    filter.mean = measurement;
+    filter.covariance = noise;
+    filter.outliers = 0;
+}
+
+/**
+ * @brief Fuse a detection in the estimate with a Kalman update
+ *
+ * @param filter
+ * @param measurement
+ * @param noise
+ * @return true if the detection is fused, false if it is rejected as an outlier
+ */
+bool fuseDetection(PositionFilter& filter, Vector3f measurement, Matrix3f noise){
+
+    //Prediction: the block is static
+    Matrix3f predicted = filter.covariance + Matrix3f::Identity() * pow(PROCESS_SIGMA, 2);
+
+    Vector3f innovation = measurement - filter.mean;
+    Matrix3f innovationCovariance = predicted + noise;
+    float distance = innovation.transpose() * innovationCovariance.inverse() * innovation;
+
+    if(distance > OUTLIER_THRESHOLD){
+        filter.outliers++;
+        if(filter.outliers >= MAX_OUTLIERS)
+            initFilter(filter, measurement, noise);
+        return false;
+    }
+
+    Matrix3f gain = predicted * innovationCovariance.inverse();
+    filter.mean += gain * innovation;
+    filter.covariance = (Matrix3f::Identity() - gain) * predicted;
+    filter.outliers = 0;
+
+    return true;
+}
@@ -0,0 +1,250 @@
+/**
+ * @file sessionLog.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the binary log of the messages received by the planner and the move node, and its reader
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The log starts with a magic number and a version, followed by a record for each message received: the topic, the time
+ * of the reception, the length of the message and the message serialised as on the wire. The messages are read back
+ * with the same serialisation, so that the replayer can feed them to the callbacks without a ROS master.
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <cstdio>
+#include <cstdint>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <ros/serialization.h>
+
+using namespace std;
+
+///Magic number at the start of a session log
+#define SESSION_LOG_MAGIC 0x4c535043 // "CPSL"
+///Version of the format of the session log
+#define SESSION_LOG_VERSION 4 // 2: orientation of the blocks in the detections, 3: yaw of the blocks in the detections and move orders, 4: yaw of the placements in the move orders
+
+///Topics recorded in the session log
+enum LogTopic : uint8_t { LOG_DETECTION, LOG_DETECTIONS, LOG_MOVE_RESULT, LOG_MOVE_PROGRESS, LOG_MOVE_ORDER, LOG_TOPIC_COUNT };
+
+///Name of each recorded topic
+const char* LOG_TOPIC_NAMES[LOG_TOPIC_COUNT] = {"vision/vision_detection", "vision/vision_detections", "move/movement_results_v2", "move/movement_progress_v2", "planner/position_v2"};
+
+/**
+ * @brief Struct to store a record of the session log, with the message still serialised
+ *
+ */
+struct LogRecord{
+    LogTopic topic;
+    double stamp; // time of the reception [s]
+    vector<uint8_t> data;
+};
+
+/**
+ * @brief Writer of the session log, recording is a no-op while the log is not open
+ *
+ */
+class SessionLog{
+public:
+    SessionLog();
+    ~SessionLog();
+
+    bool open(const string& path); // Create the log, truncating an existing file
+    void close(); // Flush and close the log
+    bool isOpen() const;
+
+    template<class M> void record(LogTopic topic, const M& msg, double stamp); // Append a received message
+
+private:
+    FILE* file;
+    mutex lock; // the callbacks of the nodes may run on different threads
+    vector<uint8_t> buffer; // reused to serialise the messages
+};
+
+/**
+ * @brief Reader of a session log
+ *
+ */
+class SessionReader{
+public:
+    SessionReader();
+    ~SessionReader();
+
+    bool open(const string& path); // Open a log and check its header
+    bool next(LogRecord& record); // Read the next record, false at the end of the log
+
+    template<class M> boost::shared_ptr<M> decode(const LogRecord& record); // Deserialise the message of a record
+
+private:
+    FILE* file;
+};
+
+/**
+ * @brief Construct a writer with no log open
+ *
+ */
+SessionLog::SessionLog(){
+    file = NULL;
+}
+
+/**
+ * @brief Flush and close the log
+ *
+ */
+SessionLog::~SessionLog(){
+    close();
+}
+
+/**
+ * @brief Create the log and write its header
+ *
+ * @param path
+ * @return true if the log is open
+ */
+bool SessionLog::open(const string& path){
+
+    lock_guard<mutex> guard(lock);
+
+    file = fopen(path.c_str(), "wb");
+    if(!file){
+        cout << "Cannot create the session log " << path << endl;
+        return false;
+    }
+
+    uint32_t header[2] = {SESSION_LOG_MAGIC, SESSION_LOG_VERSION};
+    fwrite(header, sizeof(header), 1, file);
+    cout << "Recording the session in " << path << endl;
+    return true;
+}
+
+/**
+ * @brief Flush and close the log
+ *
+ */
+void SessionLog::close(){
+
+    lock_guard<mutex> guard(lock);
+
+    if(file) fclose(file);
+    file = NULL;
+}
+
+/**
+ * @brief True if the messages are being recorded
+ *
+ * @return true
+ * @return false
+ */
+bool SessionLog::isOpen() const{
+    return file != NULL;
+}
+
+/**
+ * @brief Append a received message to the log, serialised as on the wire. The writes are buffered by the file, a record
+ * reaches the disk when the buffer is full or the log is closed
+ *
+ * @tparam M message type
+ * @param topic
+ * @param msg
+ * @param stamp time of the reception [s]
+ */
+template<class M> void SessionLog::record(LogTopic topic, const M& msg, double stamp){
+
+    if(!file) return;
+
+    lock_guard<mutex> guard(lock);
+
+    uint32_t length = ros::serialization::serializationLength(msg);
+    buffer.resize(length);
+    ros::serialization::OStream stream(buffer.data(), length);
+    ros::serialization::serialize(stream, msg);
+
+    uint8_t topicByte = topic;
+    fwrite(&topicByte, sizeof(topicByte), 1, file);
+    fwrite(&stamp, sizeof(stamp), 1, file);
+    fwrite(&length, sizeof(length), 1, file);
+    fwrite(buffer.data(), 1, length, file);
+}
+
+/**
+ * @brief Construct a reader with no log open
+ *
+ */
+SessionReader::SessionReader(){
+    file = NULL;
+}
+
+/**
+ * @brief Close the log
+ *
+ */
+SessionReader::~SessionReader(){
+    if(file) fclose(file);
+}
+
+/**
+ * @brief Open a log and check its magic number and version
+ *
+ * @param path
+ * @return true if the log can be read
+ */
+bool SessionReader::open(const string& path){
+
+    file = fopen(path.c_str(), "rb");
+    if(!file){
+        cout << "Cannot open the session log " << path << endl;
+        return false;
+    }
+
+    uint32_t header[2];
+    if(fread(header, sizeof(header), 1, file) != 1 || header[0] != SESSION_LOG_MAGIC || header[1] != SESSION_LOG_VERSION){
+        cout << path << " is not a session log of version " << SESSION_LOG_VERSION << endl;
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Read the next record, a record truncated by a crash of the node ends the log
+ *
+ * @param record
+ * @return true if a whole record is read
+ */
+bool SessionReader::next(LogRecord& record){
+
+    if(!file) return false;
+
+    uint8_t topicByte;
+    uint32_t length;
+    if(fread(&topicByte, sizeof(topicByte), 1, file) != 1 || fread(&record.stamp, sizeof(record.stamp), 1, file) != 1 ||
+       fread(&length, sizeof(length), 1, file) != 1 || topicByte >= LOG_TOPIC_COUNT)
+        return false;
+
+    record.topic = (LogTopic)topicByte;
+    record.data.resize(length);
+    return fread(record.data.data(), 1, length, file) == length;
+}
+
+/**
+ * @brief Deserialise the message of a record
+ *
+ * @tparam M message type, it must match the topic of the record
+ * @param record
+ * @return boost::shared_ptr<M>
+ */
+template<class M> boost::shared_ptr<M> SessionReader::decode(const LogRecord& record){
+
+    boost::shared_ptr<M> msg = boost::make_shared<M>();
+    ros::serialization::IStream stream((uint8_t*)record.data.data(), record.data.size());
+    ros::serialization::deserialize(stream, *msg);
+    return msg;
+}
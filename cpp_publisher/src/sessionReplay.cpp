@@ -0,0 +1,199 @@
+/**
+ * @file sessionReplay.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the offline replayer of the session logs of the planner and the move node
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The replayer feeds the messages of a session log to the callbacks of the planner as fast as possible, without a ROS
+ * master: the ROS clock is set to the time each message was received, so that the metrics of the cell are the ones of the
+ * recorded session, while the wall time measures the planner. The move orders and detection requests of the planner
+ * stay in its queues of pending messages, and are counted and dropped after every message.
+ * The replay is deterministic: the optimisation of the pick order is bounded by a number of evaluations instead of a time
+ * budget, and every candidate plan is simulated. The replayed planner may send its orders for other blocks than the
+ * recorded one, so the move acks are matched by the order of the dispatch: the acks of the n-th block acknowledged in the
+ * log are given to the n-th move order of the replay, and the acks left without an order are skipped.
+ * The move node executes its orders in real time, paced by the controller, so its logs are only summarised.
+ *
+ * Usage: session_replay <log> [structure file] [-v]
+ */
+
+#define PLANNER_NODELET // the main function of the planner is not compiled
+#include "planner.cpp"
+
+#include <chrono>
+#include <cstring>
+#include <map>
+
+///Orders evaluated by every optimisation of the pick order while replaying
+#define REPLAY_SOLVE_EVALUATIONS 2000
+
+/**
+ * @brief Struct to store the statistics of the records of a topic
+ *
+ */
+struct TopicStats{
+    int records;
+    double callbackTime; // total wall time spent in the callback [s]
+    double maxCallbackTime; // [s]
+    double age; // total time between the stamp of the message and its reception [s]
+};
+
+/**
+ * @brief Stream buffer discarding everything, used to silence the planner while replaying
+ *
+ */
+class NullBuffer : public streambuf{
+protected:
+    int overflow(int c){ return c; }
+};
+
+int main(int argc, char **argv){
+
+    if(argc < 2){
+        cout << "Usage: session_replay <log> [structure file] [-v]" << endl;
+        return 1;
+    }
+
+    bool verbose = false;
+    string structureFile;
+    for(int i = 2; i < argc; i++){
+        if(strcmp(argv[i], "-v") == 0) verbose = true;
+        else structureFile = argv[i];
+    }
+
+    SessionReader reader;
+    if(!reader.open(argv[1]))
+        return 1;
+
+    //Simulated clock driven by the stamps of the log
+    ros::Time::init();
+
+    if(!structureFile.empty())
+        assembly.load(structureFile, Vector3f(STRUCTURE_ORIGIN_X, STRUCTURE_ORIGIN_Y, 0));
+
+    //The log holds the messages of a single move node
+    addArm("", Vector3f::Zero());
+
+    orderSolveEvaluations = REPLAY_SOLVE_EVALUATIONS;
+
+    NullBuffer nullBuffer;
+    streambuf* coutBuffer = cout.rdbuf();
+    if(!verbose) cout.rdbuf(&nullBuffer);
+
+    TopicStats stats[LOG_TOPIC_COUNT] = {};
+    int moveOrders = 0, detectionRequests = 0, unmatchedAcks = 0;
+    //Move orders of the replayed planner, in the order they were sent, and the recorded block of each one
+    deque<cpp_publisher::CoordinatesV2> orders;
+    map<uint64_t, int> orderOfBlock;
+    int acknowledged = 0;
+
+    //Give the ack of a recorded block to the move order of the replay sent in the same position, NULL if there is none
+    auto matchAck = [&](const cpp_publisher::MoveOperationV2::ConstPtr& msg){
+        auto match = orderOfBlock.find(msg->blockId);
+        if(match == orderOfBlock.end()){
+            if(acknowledged == orders.size()) return cpp_publisher::MoveOperationV2::ConstPtr();
+            match = orderOfBlock.insert(make_pair(msg->blockId, acknowledged++)).first;
+        }
+        cpp_publisher::MoveOperationV2Ptr ack(new cpp_publisher::MoveOperationV2(*msg));
+        ack->blockId = orders[match->second].blockId;
+        ack->traceId = orders[match->second].traceId;
+        return cpp_publisher::MoveOperationV2::ConstPtr(ack);
+    };
+    double firstStamp = 0, lastStamp = 0;
+
+    LogRecord record;
+    auto start = chrono::steady_clock::now();
+
+    while(reader.next(record)){
+
+        if(firstStamp == 0) firstStamp = record.stamp;
+        lastStamp = record.stamp;
+        ros::Time::setNow(ros::Time().fromSec(record.stamp));
+
+        TopicStats& topic = stats[record.topic];
+        auto callbackStart = chrono::steady_clock::now();
+
+        switch(record.topic){
+            case LOG_DETECTION:
+                visionCallback(reader.decode<cpp_publisher::BlockInfo>(record));
+                break;
+            case LOG_DETECTIONS:{
+                cpp_publisher::BlockInfoArray::ConstPtr msg = reader.decode<cpp_publisher::BlockInfoArray>(record);
+                topic.age += record.stamp - msg->header.stamp.toSec();
+                visionArrayCallback(msg);
+                break;
+            }
+            case LOG_MOVE_RESULT:{
+                cpp_publisher::MoveOperationV2::ConstPtr msg = reader.decode<cpp_publisher::MoveOperationV2>(record);
+                topic.age += record.stamp - msg->header.stamp.toSec();
+                msg = matchAck(msg);
+                if(msg) movementCallback(msg);
+                else unmatchedAcks++;
+                break;
+            }
+            case LOG_MOVE_PROGRESS:{
+                cpp_publisher::MoveOperationV2::ConstPtr msg = reader.decode<cpp_publisher::MoveOperationV2>(record);
+                topic.age += record.stamp - msg->header.stamp.toSec();
+                msg = matchAck(msg);
+                if(msg) progressCallback(msg);
+                else unmatchedAcks++;
+                break;
+            }
+            case LOG_MOVE_ORDER:{
+                //Move node log: the order is not executed
+                cpp_publisher::CoordinatesV2::ConstPtr msg = reader.decode<cpp_publisher::CoordinatesV2>(record);
+                topic.age += record.stamp - msg->header.stamp.toSec();
+                break;
+            }
+            default:
+                break;
+        }
+
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - callbackStart).count();
+        topic.records++;
+        topic.callbackTime += elapsed;
+        topic.maxCallbackTime = max(topic.maxCallbackTime, elapsed);
+
+        //Nobody subscribes to the planner, its messages are queued
+        moveOrders += arms[0].pendingMoveOrders.size();
+        orders.insert(orders.end(), arms[0].pendingMoveOrders.begin(), arms[0].pendingMoveOrders.end());
+        detectionRequests += pendingDetectionRequests.size();
+        arms[0].pendingMoveOrders.clear();
+        pendingDetectionRequests.clear();
+    }
+
+    double wallTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout.rdbuf(coutBuffer);
+
+    int records = 0;
+    for(int t = 0; t < LOG_TOPIC_COUNT; t++)
+        records += stats[t].records;
+
+    cout << "Replayed " << records << " messages of a " << lastStamp - firstStamp << " s session in " << wallTime * 1000 << " ms ("
+         << (wallTime > 0 ? records / wallTime : 0) << " messages/s)" << endl;
+
+    for(int t = 0; t < LOG_TOPIC_COUNT; t++){
+        if(stats[t].records == 0) continue;
+        cout << "  " << LOG_TOPIC_NAMES[t] << ": " << stats[t].records << " messages, callback mean "
+             << stats[t].callbackTime / stats[t].records * 1000 << " ms max " << stats[t].maxCallbackTime * 1000
+             << " ms, age at reception mean " << stats[t].age / stats[t].records * 1000 << " ms" << endl;
+    }
+
+    cout << "Move orders sent: " << moveOrders << ", detection requests sent: " << detectionRequests << endl;
+    if(unmatchedAcks > 0)
+        cout << "Move acks without a move order of the replay: " << unmatchedAcks << endl;
+
+    if(stats[LOG_MOVE_RESULT].records > 0){
+        MetricsSummary summary = metrics.summary(lastStamp);
+        cout << "Blocks placed: " << summary.blocksPlaced << ", failed: " << summary.blocksFailed
+             << ", blocks per minute: " << summary.blocksPerMinute << endl;
+        for(int i = 0; i < summary.intervals.size(); i++)
+            cout << "  " << summary.intervals[i] << ": p50 " << summary.p50[i] << " s, p90 " << summary.p90[i]
+                 << " s, p99 " << summary.p99[i] << " s" << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,273 @@
+/**
+ * @file simulatedCell.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the simulated vision node and arms of a cell, driving the planner on the in-process message bus
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The planner runs its real callbacks on the message bus, without a ROS master. The vision node is simulated by a
+ * scene of blocks, reported on every detection request, and the move node by an arm that takes the time of the cycle
+ * time model, scaled down, to execute an order. The planner publishes on ROS publishers nobody subscribes to, so its
+ * messages stay in its queues of pending messages and are forwarded to the bus after every callback.
+ * With several arms every one has its move node in the namespace /armN, the bases are spread along the table.
+ * Needs planner.cpp to be included before this file.
+ */
+
+#include "messageBus.cpp" // In-process stand-in for the ROS topics
+
+#include <mutex>
+#include <condition_variable>
+#include <random>
+
+///Time spent by the simulated vision node on a detection [s]
+#define VISION_TIME 0.02
+///Minimum distance between two blocks of the simulated scene [m]
+#define BLOCK_SPACING 0.06
+///Distance between the bases of two simulated arms along the table [m]
+#define ARM_SPACING 0.3
+
+/**
+ * @brief Struct to store a block of the simulated scene
+ *
+ */
+struct SceneBlock{
+    Vector3f position;
+    int blockClass;
+    bool onTable;
+};
+
+///Bus carrying the messages between the nodes, with a fixed seed of the latency jitter
+MessageBus bus(1);
+///Blocks of the simulated scene
+vector<SceneBlock> scene;
+///Lock of the scene, blocks can be added while the cell runs
+mutex sceneLock;
+///Scale of the time spent by the simulated arm on an order
+double armTimeScale = 0.01;
+///Move results received
+int results = 0, placed = 0;
+mutex resultLock;
+condition_variable resultReady;
+
+/**
+ * @brief Time on the monotonic clock [s]
+ *
+ * @return double
+ */
+double wallClock(){
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Clock of the planner of the cell, the wall clock since there is no master. Setting the ROS clock instead would
+ * race with the other cells of the process
+ *
+ * @return ros::Time
+ */
+ros::Time cellClock(){
+    return ros::Time().fromSec(wallClock());
+}
+
+/**
+ * @brief Forward to the bus the messages the planner queued for its subscribers
+ *
+ */
+void flushPlanner(){
+
+    for(int a = 0; a < arms.size(); a++){
+        for(int i = 0; i < arms[a].pendingMoveOrders.size(); i++)
+            bus.publish(arms[a].ns + "/planner/position_v2", boost::make_shared<const cpp_publisher::CoordinatesV2>(arms[a].pendingMoveOrders[i]));
+        arms[a].pendingMoveOrders.clear();
+    }
+    for(int i = 0; i < pendingDetectionRequests.size(); i++)
+        bus.publish("/planner/detection_request", boost::make_shared<const std_msgs::Bool>(pendingDetectionRequests[i]));
+
+    pendingDetectionRequests.clear();
+}
+
+/**
+ * @brief Wrap a callback of the planner to forward its messages after it
+ *
+ * @tparam M message type
+ * @param callback
+ * @return function<void(const boost::shared_ptr<const M>&)>
+ */
+template<class M> function<void(const boost::shared_ptr<const M>&)> plannerCallback(void (*callback)(const boost::shared_ptr<const M>&)){
+    return [callback](const boost::shared_ptr<const M>& msg){
+        callback(msg);
+        lock_guard<mutex> guard(plannerLock);
+        flushPlanner();
+    };
+}
+
+/**
+ * @brief Simulated vision node: report every block still on the table
+ *
+ * @param request
+ */
+void simulatedVision(const std_msgs::Bool::ConstPtr& request){
+
+    cpp_publisher::BlockInfoArrayPtr msg(new cpp_publisher::BlockInfoArray);
+    msg->header.stamp = ros::Time().fromSec(wallClock());
+    msg->header.frame_id = "world";
+
+    lock_guard<mutex> guard(sceneLock);
+    for(int i = 0; i < scene.size(); i++){
+        if(!scene[i].onTable) continue;
+        cpp_publisher::BlockInfoV2 block;
+        block.header = msg->header;
+        block.blockId = i;
+        block.blockClass = scene[i].blockClass;
+        block.blockPosition.x = scene[i].position(0);
+        block.blockPosition.y = scene[i].position(1);
+        block.blockPosition.z = scene[i].position(2);
+        block.confidence = 0.9;
+        msg->blocks.push_back(block);
+    }
+
+    bus.publish("/vision/vision_detections", cpp_publisher::BlockInfoArrayConstPtr(msg), VISION_TIME);
+}
+
+/**
+ * @brief Publish a stage or the result of a simulated move order after a delay
+ *
+ * @param topic
+ * @param order
+ * @param result
+ * @param delay [s]
+ */
+void publishMoveUpdate(const string& topic, const cpp_publisher::CoordinatesV2& order, const string& result, double delay){
+
+    cpp_publisher::MoveOperationV2Ptr msg(new cpp_publisher::MoveOperationV2);
+    msg->blockId = order.blockId;
+    msg->traceId = order.traceId;
+    msg->result = result;
+    //The stamp is the time the stage is reached
+    msg->header.stamp = ros::Time().fromSec(wallClock() + delay);
+
+    bus.publish(topic, cpp_publisher::MoveOperationV2ConstPtr(msg), delay);
+}
+
+/**
+ * @brief Simulated move node of an arm: remove the block from the table and report the stages of the order at the times
+ * given by the cycle time model from the base of the arm, scaled
+ *
+ * @param order
+ * @param arm
+ */
+void simulatedMove(const cpp_publisher::CoordinatesV2::ConstPtr& order, int arm){
+
+    Vector3f from(order->from.x, order->from.y, order->from.z);
+    Vector3f to(order->to.x, order->to.y, order->to.z);
+
+    int nearest = -1;
+    {
+        lock_guard<mutex> guard(sceneLock);
+        for(int i = 0; i < scene.size(); i++)
+            if(scene[i].onTable && (nearest < 0 || (scene[i].position - from).norm() < (scene[nearest].position - from).norm()))
+                nearest = i;
+        if(nearest >= 0) scene[nearest].onTable = false;
+    }
+
+    double cycle;
+    string ns;
+    {
+        lock_guard<mutex> guard(plannerLock);
+        cycle = dispatcher.cycleTime(arm, from, to) * armTimeScale;
+        ns = arms[arm].ns;
+    }
+
+    publishMoveUpdate(ns + "/move/movement_progress_v2", *order, "started", 0);
+    publishMoveUpdate(ns + "/move/movement_progress_v2", *order, "grasped", cycle * 0.3);
+    publishMoveUpdate(ns + "/move/movement_progress_v2", *order, "left check point", cycle * 0.45);
+    publishMoveUpdate(ns + "/move/movement_progress_v2", *order, "placed", cycle * 0.85);
+    publishMoveUpdate(ns + "/move/movement_results_v2", *order, nearest >= 0 ? "success" : "fail - Block not found", cycle);
+}
+
+/**
+ * @brief Count the move results
+ *
+ * @param msg
+ */
+void resultMonitor(const cpp_publisher::MoveOperationV2::ConstPtr& msg){
+    lock_guard<mutex> guard(resultLock);
+    results++;
+    if(msg->result == "success") placed++;
+    resultReady.notify_one();
+}
+
+/**
+ * @brief Add random blocks to the scene, in the workspace of the planner and spaced from the blocks on the table
+ *
+ * @param count
+ * @param random
+ * @return int number of blocks added, less than count if the table is too crowded
+ */
+int addSceneBlocks(int count, mt19937& random){
+
+    uniform_real_distribution<float> x(0.1, 0.4), y(0.1, 0.7);
+    uniform_int_distribution<int> blockClass(0, BLOCK_CLASSES - 1);
+
+    lock_guard<mutex> guard(sceneLock);
+    int added = 0;
+    for(int attempts = 0; added < count && attempts < count * 1000; attempts++){
+        SceneBlock block = {Vector3f(x(random), y(random), 0.87), blockClass(random), true};
+        bool spaced = true;
+        for(int i = 0; i < scene.size(); i++)
+            if(scene[i].onTable && (scene[i].position - block.position).head<2>().norm() < BLOCK_SPACING) spaced = false;
+        if(spaced){
+            scene.push_back(block);
+            added++;
+        }
+    }
+    return added;
+}
+
+/**
+ * @brief Number of blocks of the scene still on the table
+ *
+ * @return int
+ */
+int blocksOnTable(){
+    lock_guard<mutex> guard(sceneLock);
+    int count = 0;
+    for(int i = 0; i < scene.size(); i++)
+        if(scene[i].onTable) count++;
+    return count;
+}
+
+/**
+ * @brief Add the arms to the planner and subscribe the planner and the simulated nodes to the bus, a single arm keeps the
+ * topics of the root namespace
+ *
+ * @param armCount
+ * @param latency latency of every topic [s]
+ * @param jitter [s]
+ */
+void setupSimulatedCell(int armCount, double latency, double jitter){
+
+    plannerClock = cellClock;
+
+    bus.setLatency("/planner/detection_request", latency, jitter);
+    bus.setLatency("/vision/vision_detections", latency, jitter);
+    bus.subscribe<cpp_publisher::BlockInfoArray>("/vision/vision_detections", plannerCallback(visionArrayCallback));
+    bus.subscribe<std_msgs::Bool>("/planner/detection_request", simulatedVision);
+
+    for(int a = 0; a < armCount; a++){
+        string ns = armCount > 1 ? "/arm" + to_string(a) : "";
+        addArm(ns, Vector3f(0, (a - (armCount - 1) / 2.0) * ARM_SPACING, 0));
+
+        const char* topics[] = {"/planner/position_v2", "/move/movement_results_v2", "/move/movement_progress_v2"};
+        for(int i = 0; i < 3; i++)
+            bus.setLatency(ns + topics[i], latency, jitter);
+
+        bus.subscribe<cpp_publisher::MoveOperationV2>(ns + "/move/movement_results_v2", plannerCallback(movementCallback));
+        bus.subscribe<cpp_publisher::MoveOperationV2>(ns + "/move/movement_progress_v2", plannerCallback(progressCallback));
+        bus.subscribe<cpp_publisher::MoveOperationV2>(ns + "/move/movement_results_v2", resultMonitor);
+        bus.subscribe<cpp_publisher::CoordinatesV2>(ns + "/planner/position_v2", [a](const cpp_publisher::CoordinatesV2::ConstPtr& order){
+            simulatedMove(order, a);
+        });
+    }
+}
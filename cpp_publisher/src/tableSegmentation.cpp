@@ -0,0 +1,334 @@
+/**
+ * @file tableSegmentation.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the segmentation of the blocks on the table from the point cloud
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The points of the organized point cloud over the workspace are moved to the world frame, keeping their pixel. The plane
+ * of the table is fitted with RANSAC on a sample of them and refined with least squares on its inliers. The points above
+ * the plane are put in a voxel grid and the occupied voxels are grouped in clusters of touching voxels, one for each block.
+ * Every cluster gives the region of the image covered by the block, so that the detector runs on a small patch, and its
+ * points, one per voxel, for the estimation of the pose of the block. The principal axes of the points give the yaw of
+ * the block on the table, used to grasp it along its short side.
+ * Needs pointCloudLookup.cpp to be included before this file.
+ */
+
+#include <vector>
+#include <unordered_map>
+#include <random>
+#include <algorithm>
+#include <cstdint>
+
+///Step between the pixels of the point cloud used [pixel]
+#define SEGMENTATION_STRIDE 2
+///Iterations of the RANSAC fit of the table
+#define PLANE_ITERATIONS 200
+///Points sampled to score the candidate planes
+#define PLANE_SAMPLES 2000
+///Maximum distance of a point of the table from the plane [m]
+#define PLANE_THRESHOLD 0.006
+///Minimum and maximum height of a point of a block over the table [m]
+#define BLOCK_MIN_HEIGHT 0.008
+#define BLOCK_MAX_HEIGHT 0.12
+///Side of the voxels of the clustering [m]
+#define VOXEL_SIZE 0.005
+///Minimum and maximum number of voxels of a block
+#define CLUSTER_MIN_VOXELS 8
+#define CLUSTER_MAX_VOXELS 4000
+///Margin added around the pixels of a block in its region of interest [pixel]
+#define ROI_MARGIN 12
+///Maximum ratio between the two spreads of a block on the table to take the direction of the larger one as its long side
+#define YAW_MAX_SPREAD_RATIO 0.8
+
+/**
+ * @brief Struct to store a point of the cloud in the world frame with its pixel
+ *
+ */
+struct PixelPoint{
+    Vector3f position;
+    int u, v;
+};
+
+/**
+ * @brief Struct to store a block segmented from the point cloud
+ *
+ */
+struct BlockCluster{
+    Vector3f centroid; // world frame
+    int u0, v0, u1, v1; // region of interest in the image, u1 and v1 excluded [pixel]
+    vector<Vector3f> points; // world frame, one per voxel
+    float yaw; // rotation about the world z axis of the long side from the y axis, in (-pi/2, pi/2], 0 if the block is square
+};
+
+/**
+ * @brief Struct to store the result of the segmentation of a point cloud
+ *
+ */
+struct TableSegmentation{
+    bool planeFound;
+    Vector3f normal; // normal of the table, pointing up
+    float offset; // the points of the table have normal.dot(p) + offset = 0
+    vector<BlockCluster> clusters;
+};
+
+/**
+ * @brief Key of a voxel in the grid
+ *
+ * @param x index of the voxel along x
+ * @param y
+ * @param z
+ * @return int64_t
+ */
+static int64_t voxelKey(int x, int y, int z){
+    return ((int64_t)(x & 0x1fffff) << 42) | ((int64_t)(y & 0x1fffff) << 21) | (int64_t)(z & 0x1fffff);
+}
+
+/**
+ * @brief Read the points of an organized point cloud inside a box of the world frame, every SEGMENTATION_STRIDE pixels
+ *
+ * @param cloud
+ * @param boxMin
+ * @param boxMax
+ * @return vector<PixelPoint>
+ */
+vector<PixelPoint> workspacePoints(const sensor_msgs::PointCloud2& cloud, Vector3f boxMin, Vector3f boxMax){
+
+    vector<PixelPoint> points;
+    CloudLayout layout = cloudLayout(cloud);
+    if(!layout.valid) return points;
+
+    points.reserve((cloud.width / SEGMENTATION_STRIDE) * (cloud.height / SEGMENTATION_STRIDE) / 4);
+    for(int v = 0; v < cloud.height; v += SEGMENTATION_STRIDE){
+        for(int u = 0; u < cloud.width; u += SEGMENTATION_STRIDE){
+            Vector3f point;
+            if(!cloudPoint(cloud, layout, u, v, point)) continue;
+            point = cameraToWorld(point);
+            if((point.array() < boxMin.array()).any() || (point.array() > boxMax.array()).any()) continue;
+            points.push_back({point, u, v});
+        }
+    }
+
+    return points;
+}
+
+/**
+ * @brief Fit the plane of the table with RANSAC, the plane with the most points within PLANE_THRESHOLD in a sample wins
+ * and is refined with least squares on all its inliers
+ *
+ * @param points
+ * @param normal normal of the plane, pointing up
+ * @param offset
+ * @param random
+ * @return true if a plane was found
+ */
+bool fitTablePlane(const vector<PixelPoint>& points, Vector3f& normal, float& offset, mt19937& random){
+
+    if(points.size() < 3) return false;
+
+    uniform_int_distribution<int> pick(0, points.size() - 1);
+    vector<int> sample(min((int)points.size(), PLANE_SAMPLES));
+    for(int i = 0; i < sample.size(); i++)
+        sample[i] = points.size() <= PLANE_SAMPLES ? i : pick(random);
+
+    int bestInliers = 0;
+    for(int iteration = 0; iteration < PLANE_ITERATIONS; iteration++){
+        const Vector3f& a = points[pick(random)].position;
+        const Vector3f& b = points[pick(random)].position;
+        const Vector3f& c = points[pick(random)].position;
+        Vector3f n = (b - a).cross(c - a);
+        if(n.norm() < 1e-9) continue;
+        n.normalize();
+        //The table is horizontal, the planes of the sides of the blocks are discarded
+        if(fabs(n(2)) < 0.9) continue;
+        if(n(2) < 0) n = -n;
+        float d = -n.dot(a);
+
+        int inliers = 0;
+        for(int i = 0; i < sample.size(); i++)
+            if(fabs(n.dot(points[sample[i]].position) + d) < PLANE_THRESHOLD) inliers++;
+
+        if(inliers > bestInliers){
+            bestInliers = inliers;
+            normal = n;
+            offset = d;
+        }
+    }
+
+    if(bestInliers < 3) return false;
+
+    //Least squares on the inliers: the normal is the direction of least variance
+    Vector3f mean = Vector3f::Zero();
+    int count = 0;
+    for(int i = 0; i < points.size(); i++){
+        if(fabs(normal.dot(points[i].position) + offset) >= PLANE_THRESHOLD) continue;
+        mean += points[i].position;
+        count++;
+    }
+    mean /= count;
+
+    Eigen::Matrix3f covariance = Eigen::Matrix3f::Zero();
+    for(int i = 0; i < points.size(); i++){
+        if(fabs(normal.dot(points[i].position) + offset) >= PLANE_THRESHOLD) continue;
+        Vector3f d = points[i].position - mean;
+        covariance += d * d.transpose();
+    }
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(covariance);
+    Vector3f refined = solver.eigenvectors().col(0);
+    if(refined(2) < 0) refined = -refined;
+    normal = refined;
+    offset = -normal.dot(mean);
+
+    return true;
+}
+
+/**
+ * @brief Yaw of a block from the principal axes of its points: the eigenvector of the largest eigenvalue of their
+ * covariance, projected on the table, is the long side of the block
+ *
+ * @param points points of the block in the world frame
+ * @param normal normal of the table
+ * @return float rotation about the world z axis of the long side from the y axis, in (-pi/2, pi/2], 0 if the block is square
+ */
+float clusterYaw(const vector<Vector3f>& points, Vector3f normal){
+
+    if(points.size() < 3) return 0;
+
+    Vector3f mean = Vector3f::Zero();
+    for(int i = 0; i < points.size(); i++)
+        mean += points[i];
+    mean /= points.size();
+
+    //Covariance of the points on the plane of the table, the height of the block does not count
+    Eigen::Matrix3f projection = Eigen::Matrix3f::Identity() - normal * normal.transpose();
+    Eigen::Matrix3f covariance = Eigen::Matrix3f::Zero();
+    for(int i = 0; i < points.size(); i++){
+        Vector3f d = projection * (points[i] - mean);
+        covariance += d * d.transpose();
+    }
+
+    //Eigenvalues in increasing order: the first is along the normal, the last along the long side
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(covariance);
+    Vector3f spread = solver.eigenvalues();
+    if(spread(2) <= 0 || spread(1) / spread(2) > YAW_MAX_SPREAD_RATIO * YAW_MAX_SPREAD_RATIO)
+        return 0;
+
+    Vector3f axis = solver.eigenvectors().col(2);
+    float yaw = atan2(axis(1), axis(0)) - M_PI / 2;
+    while(yaw > M_PI / 2) yaw -= M_PI;
+    while(yaw <= -M_PI / 2) yaw += M_PI;
+    return yaw;
+}
+
+/**
+ * @brief Segment the blocks on the table: fit the plane of the table, keep the points above it and group them in clusters
+ * of touching voxels
+ *
+ * @param cloud organized point cloud of the camera
+ * @param boxMin corner of the workspace in the world frame
+ * @param boxMax opposite corner of the workspace
+ * @param random
+ * @return TableSegmentation
+ */
+TableSegmentation segmentTable(const sensor_msgs::PointCloud2& cloud, Vector3f boxMin, Vector3f boxMax, mt19937& random){
+
+    TableSegmentation result;
+    result.planeFound = false;
+
+    vector<PixelPoint> points = workspacePoints(cloud, boxMin, boxMax);
+    if(!fitTablePlane(points, result.normal, result.offset, random))
+        return result;
+    result.planeFound = true;
+
+    /**
+     * @brief Struct to store the points of an occupied voxel
+     *
+     */
+    struct Voxel{
+        int x, y, z;
+        Vector3f sum;
+        int count;
+        int u0, v0, u1, v1;
+        int cluster;
+    };
+
+    //Voxel grid of the points above the table
+    vector<Voxel> voxels;
+    unordered_map<int64_t, int> grid;
+    for(int i = 0; i < points.size(); i++){
+        float height = result.normal.dot(points[i].position) + result.offset;
+        if(height < BLOCK_MIN_HEIGHT || height > BLOCK_MAX_HEIGHT) continue;
+
+        const PixelPoint& p = points[i];
+        int x = floor(p.position(0) / VOXEL_SIZE), y = floor(p.position(1) / VOXEL_SIZE), z = floor(p.position(2) / VOXEL_SIZE);
+        auto inserted = grid.insert(make_pair(voxelKey(x, y, z), (int)voxels.size()));
+        if(inserted.second)
+            voxels.push_back({x, y, z, Vector3f::Zero(), 0, p.u, p.v, p.u, p.v, -1});
+
+        Voxel& voxel = voxels[inserted.first->second];
+        voxel.sum += p.position;
+        voxel.count++;
+        voxel.u0 = min(voxel.u0, p.u);
+        voxel.v0 = min(voxel.v0, p.v);
+        voxel.u1 = max(voxel.u1, p.u);
+        voxel.v1 = max(voxel.v1, p.v);
+    }
+
+    //Euclidean clustering on the voxels: the voxels touching by a face, an edge or a corner are in the same block
+    vector<int> stack;
+    for(int seed = 0; seed < voxels.size(); seed++){
+        if(voxels[seed].cluster >= 0) continue;
+
+        //The seed voxel labels its cluster
+        int id = seed;
+        vector<int> members;
+        voxels[seed].cluster = id;
+        stack.push_back(seed);
+        while(!stack.empty()){
+            int current = stack.back();
+            stack.pop_back();
+            members.push_back(current);
+
+            for(int dx = -1; dx <= 1; dx++)
+                for(int dy = -1; dy <= 1; dy++)
+                    for(int dz = -1; dz <= 1; dz++){
+                        auto neighbour = grid.find(voxelKey(voxels[current].x + dx, voxels[current].y + dy, voxels[current].z + dz));
+                        if(neighbour == grid.end() || voxels[neighbour->second].cluster >= 0) continue;
+                        voxels[neighbour->second].cluster = id;
+                        stack.push_back(neighbour->second);
+                    }
+        }
+
+        //Noise or something that is not a block
+        if(members.size() < CLUSTER_MIN_VOXELS || members.size() > CLUSTER_MAX_VOXELS)
+            continue;
+
+        BlockCluster cluster;
+        cluster.centroid = Vector3f::Zero();
+        cluster.u0 = cluster.v0 = INT32_MAX;
+        cluster.u1 = cluster.v1 = -1;
+        int count = 0;
+        for(int i = 0; i < members.size(); i++){
+            const Voxel& voxel = voxels[members[i]];
+            cluster.points.push_back(voxel.sum / voxel.count);
+            cluster.centroid += voxel.sum;
+            count += voxel.count;
+            cluster.u0 = min(cluster.u0, voxel.u0);
+            cluster.v0 = min(cluster.v0, voxel.v0);
+            cluster.u1 = max(cluster.u1, voxel.u1);
+            cluster.v1 = max(cluster.v1, voxel.v1);
+        }
+        cluster.centroid /= count;
+        cluster.u0 = max(0, cluster.u0 - ROI_MARGIN);
+        cluster.v0 = max(0, cluster.v0 - ROI_MARGIN);
+        cluster.u1 = min((int)cloud.width, cluster.u1 + SEGMENTATION_STRIDE + ROI_MARGIN);
+        cluster.v1 = min((int)cloud.height, cluster.v1 + SEGMENTATION_STRIDE + ROI_MARGIN);
+        cluster.yaw = clusterYaw(cluster.points, result.normal);
+        result.clusters.push_back(cluster);
+    }
+
+    return result;
+}
@@ -0,0 +1,376 @@
+/**
+ * @file targetAllocator.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the allocator of the placements of the blocks in the target area
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The target area is an occupancy grid filled with shelves: strips running along y as deep as the blocks they hold.
+ * Each block footprint is placed on the shelf that wastes less space, the shelves are indexed by depth and free length
+ * so that every placement costs O(log n) in the number of shelves. A block can also take the free slot nearest to a
+ * position, the end of a shelf or a new shelf, to shorten its transport at the cost of a looser packing.
+ */
+
+#include <iostream>
+#include <Eigen/Dense>
+#include <vector>
+#include <map>
+#include <set>
+#include <cmath>
+
+using namespace std;
+using Eigen::Vector3f;
+
+///Limits of the target area in the world frame [m]
+#define TARGET_AREA_MIN_X 0.65
+#define TARGET_AREA_MAX_X 0.95
+#define TARGET_AREA_MIN_Y 0.2
+#define TARGET_AREA_MAX_Y 0.75
+///Height in the world frame of the placements
+#define TARGET_AREA_Z 0.9
+///Side of a cell of the occupancy grid [m]
+#define GRID_RESOLUTION 0.005
+///Free space left around each block for the gripper fingers [m]
+#define PLACEMENT_CLEARANCE 0.01
+
+///Footprint of each block class along the x and y axis of the block [m], from the STL models
+const float BLOCK_FOOTPRINT[][2] = {
+    {0.031, 0.031}, // X1-Y1-Z2
+    {0.031, 0.063}, // X1-Y2-Z1
+    {0.031, 0.063}, // X1-Y2-Z2
+    {0.031, 0.063}, // X1-Y2-Z2-CHAMFER
+    {0.031, 0.063}, // X1-Y2-Z2-TWINFILLET
+    {0.031, 0.095}, // X1-Y3-Z2
+    {0.031, 0.095}, // X1-Y3-Z2-FILLET
+    {0.031, 0.127}, // X1-Y4-Z1
+    {0.031, 0.127}, // X1-Y4-Z2
+    {0.063, 0.063}, // X2-Y2-Z2
+    {0.063, 0.063}  // X2-Y2-Z2-FILLET
+};
+
+///Height of each block class [m], from the STL models
+const float BLOCK_HEIGHT[] = {0.057, 0.038, 0.057, 0.057, 0.057, 0.057, 0.057, 0.038, 0.057, 0.057, 0.057};
+
+/**
+ * @brief Struct to store the placement of a block in the target area
+ *
+ */
+struct Placement{
+    Vector3f position; // world frame position of the center of the block
+    float yaw; // rotation of the block around z, 0 or pi/2
+};
+
+/**
+ * @brief Occupancy grid of the target area packed with shelves of blocks
+ *
+ */
+class TargetAllocator{
+public:
+    TargetAllocator();
+
+    bool allocate(int blockClass, bool allowRotation, Placement& placement); // Reserve the placement of a block
+    bool allocateNear(int blockClass, bool allowRotation, Vector3f position, Placement& placement); // Reserve the free placement nearest to a position
+    bool preview(int blockClass, bool allowRotation, Placement& placement) const; // Placement the next block would get, without reserving it
+    bool isOccupied(Vector3f position) const; // Check if a point of the target area is occupied
+    int placedBlocks() const; // Number of blocks placed so far
+
+private:
+    /**
+     * @brief Struct to store a shelf, a strip of the grid running along y
+     *
+     */
+    struct Shelf{
+        int row; // first row (x) of the shelf
+        int depth; // rows (x) covered by the shelf
+        int used; // columns (y) already used
+    };
+
+    /**
+     * @brief Struct to store where a footprint fits
+     *
+     */
+    struct Fit{
+        int shelf; // index of the shelf, -1 to open a new one
+        int depth;
+        int length;
+        bool rotated;
+    };
+
+    int rows, cols;
+    int nextRow; // first row not covered by any shelf
+    int placed;
+    vector<vector<bool>> grid;
+    vector<Shelf> shelves;
+    map<int, set<pair<int, int>>> freeByDepth; // shelf depth -> (free columns, shelf index)
+
+    bool findFit(int depth, int length, Fit& fit) const;
+    bool findBestFit(int blockClass, bool allowRotation, Fit& fit) const;
+    bool findNearestFit(int blockClass, bool allowRotation, Vector3f position, Fit& fit) const;
+    void reserve(Fit fit, Placement& placement);
+    Placement toPlacement(const Fit& fit, int row, int column) const;
+};
+
+/**
+ * @brief Construct an empty allocator covering the target area
+ *
+ */
+TargetAllocator::TargetAllocator(){
+    rows = floor((TARGET_AREA_MAX_X - TARGET_AREA_MIN_X) / GRID_RESOLUTION);
+    cols = floor((TARGET_AREA_MAX_Y - TARGET_AREA_MIN_Y) / GRID_RESOLUTION);
+    nextRow = 0;
+    placed = 0;
+    grid.assign(rows, vector<bool>(cols, false));
+}
+
+/**
+ * @brief Find the shelf where a footprint of depth x length cells wastes less space.
+ * Among the shelves at least as deep as the footprint, the shallowest is preferred and then the one with less free columns left
+ *
+ * @param depth
+ * @param length
+ * @param fit
+ * @return true if the footprint fits in an existing shelf or in a new one
+ */
+bool TargetAllocator::findFit(int depth, int length, Fit& fit) const{
+
+    //The depths are the ones of the block classes, so this loop runs a bounded number of times
+    for(auto it = freeByDepth.lower_bound(depth); it != freeByDepth.end(); it++){
+        auto shelf = it->second.lower_bound(make_pair(length, -1));
+        if(shelf != it->second.end()){
+            fit.shelf = shelf->second;
+            fit.depth = depth;
+            fit.length = length;
+            return true;
+        }
+    }
+
+    if(nextRow + depth <= rows && length <= cols){
+        fit.shelf = -1;
+        fit.depth = depth;
+        fit.length = length;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Find the best fit of a block, trying also the rotated footprint if allowed
+ *
+ * @param blockClass
+ * @param allowRotation
+ * @param fit
+ * @return true if the block fits in the target area
+ */
+bool TargetAllocator::findBestFit(int blockClass, bool allowRotation, Fit& fit) const{
+
+    int footprintX = ceil((BLOCK_FOOTPRINT[blockClass][0] + 2 * PLACEMENT_CLEARANCE) / GRID_RESOLUTION);
+    int footprintY = ceil((BLOCK_FOOTPRINT[blockClass][1] + 2 * PLACEMENT_CLEARANCE) / GRID_RESOLUTION);
+
+    bool found = false;
+    Fit candidate;
+
+    for(int rotated = 0; rotated <= (allowRotation ? 1 : 0); rotated++){
+        int depth = rotated ? footprintY : footprintX;
+        int length = rotated ? footprintX : footprintY;
+        if(!findFit(depth, length, candidate)) continue;
+        candidate.rotated = rotated;
+
+        //Prefer existing shelves, then the shelf with less wasted depth
+        if(!found || (candidate.shelf >= 0 && fit.shelf < 0) ||
+           (candidate.shelf >= 0 && fit.shelf >= 0 && shelves[candidate.shelf].depth - candidate.depth < shelves[fit.shelf].depth - fit.depth) ||
+           (candidate.shelf < 0 && fit.shelf < 0 && candidate.depth < fit.depth)){
+            fit = candidate;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * @brief Find the free slot of a block nearest to a position: the end of a shelf deep and long enough, or the start of a
+ * new shelf, trying also the rotated footprint if allowed
+ *
+ * @param blockClass
+ * @param allowRotation
+ * @param position world frame position
+ * @param fit
+ * @return true if the block fits in the target area
+ */
+bool TargetAllocator::findNearestFit(int blockClass, bool allowRotation, Vector3f position, Fit& fit) const{
+
+    int footprintX = ceil((BLOCK_FOOTPRINT[blockClass][0] + 2 * PLACEMENT_CLEARANCE) / GRID_RESOLUTION);
+    int footprintY = ceil((BLOCK_FOOTPRINT[blockClass][1] + 2 * PLACEMENT_CLEARANCE) / GRID_RESOLUTION);
+
+    bool found = false;
+    float nearest = 0;
+    Fit candidate;
+
+    for(int rotated = 0; rotated <= (allowRotation ? 1 : 0); rotated++){
+        candidate.depth = rotated ? footprintY : footprintX;
+        candidate.length = rotated ? footprintX : footprintY;
+        candidate.rotated = rotated;
+
+        //Every shelf is a candidate, the new shelf is the last one
+        for(int i = 0; i <= shelves.size(); i++){
+            int row, column;
+            if(i < shelves.size()){
+                if(shelves[i].depth < candidate.depth || shelves[i].used + candidate.length > cols) continue;
+                row = shelves[i].row;
+                column = shelves[i].used;
+                candidate.shelf = i;
+            }else{
+                if(nextRow + candidate.depth > rows || candidate.length > cols) continue;
+                row = nextRow;
+                column = 0;
+                candidate.shelf = -1;
+            }
+
+            float distance = (toPlacement(candidate, row, column).position - position).head<2>().norm();
+            if(!found || distance < nearest){
+                fit = candidate;
+                nearest = distance;
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
+
+/**
+ * @brief Convert a fit placed at a given cell to the world frame placement of the block center
+ *
+ * @param fit
+ * @param row
+ * @param column
+ * @return Placement
+ */
+Placement TargetAllocator::toPlacement(const Fit& fit, int row, int column) const{
+    Placement placement;
+    placement.position << TARGET_AREA_MIN_X + (row + fit.depth / 2.0) * GRID_RESOLUTION,
+                          TARGET_AREA_MIN_Y + (column + fit.length / 2.0) * GRID_RESOLUTION,
+                          TARGET_AREA_Z;
+    placement.yaw = fit.rotated ? M_PI_2 : 0;
+    return placement;
+}
+
+/**
+ * @brief Reserve the placement of a block of a given class in the target area
+ *
+ * @param blockClass
+ * @param allowRotation true if the block can be placed rotated by pi/2
+ * @param placement
+ * @return true if the block fits in the target area
+ */
+bool TargetAllocator::allocate(int blockClass, bool allowRotation, Placement& placement){
+
+    Fit fit;
+    if(!findBestFit(blockClass, allowRotation, fit))
+        return false;
+
+    reserve(fit, placement);
+    return true;
+}
+
+/**
+ * @brief Reserve the free placement of a block of a given class nearest to a position
+ *
+ * @param blockClass
+ * @param allowRotation true if the block can be placed rotated by pi/2
+ * @param position world frame position, usually the one of the block
+ * @param placement
+ * @return true if the block fits in the target area
+ */
+bool TargetAllocator::allocateNear(int blockClass, bool allowRotation, Vector3f position, Placement& placement){
+
+    Fit fit;
+    if(!findNearestFit(blockClass, allowRotation, position, fit))
+        return false;
+
+    reserve(fit, placement);
+    return true;
+}
+
+/**
+ * @brief Mark the cells of a fit as occupied, opening its shelf if it is a new one
+ *
+ * @param fit
+ * @param placement
+ */
+void TargetAllocator::reserve(Fit fit, Placement& placement){
+
+    if(fit.shelf < 0){
+        Shelf shelf;
+        shelf.row = nextRow;
+        shelf.depth = fit.depth;
+        shelf.used = 0;
+        nextRow += fit.depth;
+        shelves.push_back(shelf);
+        fit.shelf = shelves.size() - 1;
+    }else{
+        freeByDepth[shelves[fit.shelf].depth].erase(make_pair(cols - shelves[fit.shelf].used, fit.shelf));
+    }
+
+    Shelf& shelf = shelves[fit.shelf];
+    int column = shelf.used;
+    for(int r = shelf.row; r < shelf.row + fit.depth; r++)
+        for(int c = column; c < column + fit.length; c++)
+            grid[r][c] = true;
+
+    shelf.used += fit.length;
+    if(shelf.used < cols)
+        freeByDepth[shelf.depth].insert(make_pair(cols - shelf.used, fit.shelf));
+
+    placement = toPlacement(fit, shelf.row, column);
+    placed++;
+}
+
+/**
+ * @brief Placement the next block of a given class would get, without reserving it
+ *
+ * @param blockClass
+ * @param allowRotation
+ * @param placement
+ * @return true if the block fits in the target area
+ */
+bool TargetAllocator::preview(int blockClass, bool allowRotation, Placement& placement) const{
+
+    Fit fit;
+    if(!findBestFit(blockClass, allowRotation, fit))
+        return false;
+
+    if(fit.shelf < 0)
+        placement = toPlacement(fit, nextRow, 0);
+    else
+        placement = toPlacement(fit, shelves[fit.shelf].row, shelves[fit.shelf].used);
+
+    return true;
+}
+
+/**
+ * @brief Check if a point of the target area is occupied by a placed block or its clearance
+ *
+ * @param position world frame position
+ * @return true
+ * @return false
+ */
+bool TargetAllocator::isOccupied(Vector3f position) const{
+    int row = floor((position(0) - TARGET_AREA_MIN_X) / GRID_RESOLUTION);
+    int column = floor((position(1) - TARGET_AREA_MIN_Y) / GRID_RESOLUTION);
+    if(row < 0 || row >= rows || column < 0 || column >= cols)
+        return false;
+    return grid[row][column];
+}
+
+/**
+ * @brief Number of blocks placed so far
+ *
+ * @return int
+ */
+int TargetAllocator::placedBlocks() const{
+    return placed;
+}
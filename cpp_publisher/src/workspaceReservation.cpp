@@ -0,0 +1,456 @@
+/**
+ * @file workspaceReservation.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the table of the reservations of the workspace shared by the arms of a cell
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The table is divided in square cells, every cell holds a few time windows reserved by the move nodes, with the owner
+ * and the start and end of the window. Before executing an order a move node reserves the corridor swept by the arm through
+ * the waypoints of the order, and waits while another arm holds a window overlapping its own. Every segment between two
+ * waypoints is reserved only from the time the arm reaches its first point to the latest time it can leave its last one,
+ * so two arms can work at the same time in the parts of the table they cross at different times. A new reservation
+ * replaces every window of the move node. A window ends by itself, so the cells of a move node that died are freed after
+ * its end.
+ * The table lives in shared memory, so every move node of the host sees the same reservations. Every cell is protected by a
+ * seqlock: the readers never lock, they retry if a writer changed the cell while they were copying it, and the writers
+ * lock the cells of a corridor in ascending order, so that two writers never deadlock. The writers of a cell are serialised
+ * by a robust process shared mutex: a writer that is only slow keeps its lock, the lock of a writer that died is
+ * recovered by the next one. The move nodes are told apart by their process and namespace, so the move nodes loaded as
+ * nodelets in the same manager do not share their windows.
+ */
+
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <cerrno>
+#include <new>
+#include <string>
+#include <functional>
+#include <Eigen/Dense>
+
+#include <pthread.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+using Eigen::Vector3f;
+
+///Name of the shared memory object of the table, the version is changed with its layout
+#define RESERVATION_TABLE_NAME "/cpp_publisher_workspace_v2"
+///World frame area covered by the table [m]
+#define RESERVATION_MIN_X 0.0
+#define RESERVATION_MAX_X 1.0
+#define RESERVATION_MIN_Y 0.0
+#define RESERVATION_MAX_Y 0.8
+///Side of a cell [m]
+#define RESERVATION_CELL 0.05
+#define RESERVATION_COLUMNS 20
+#define RESERVATION_ROWS 16
+///Number of windows a cell can hold
+#define RESERVATION_SLOTS 4
+///Time a move node waits for the one creating the table to initialise it [s]
+#define RESERVATION_INIT_TIMEOUT 1.0
+///Number of attempts of a reader on a cell being written
+#define RESERVATION_READ_RETRIES 1000
+
+/**
+ * @brief Struct to store a time window reserved on a cell, every field is a lock free atomic
+ *
+ */
+struct ReservationSlot{
+    atomic<uint64_t> owner; // 0 if the slot is free
+    atomic<double> start; // monotonic clock [s]
+    atomic<double> end; // monotonic clock [s]
+};
+
+/**
+ * @brief Struct to store the window of a cell of a corridor
+ *
+ */
+struct CellWindow{
+    int cell;
+    double start; // monotonic clock [s]
+    double end; // monotonic clock [s]
+};
+
+/**
+ * @brief Struct to store the windows reserved on a cell
+ *
+ */
+struct ReservationCell{
+    pthread_mutex_t lock; // held by the writer of the cell
+    atomic<uint32_t> sequence; // odd while a writer is updating the cell
+    ReservationSlot slots[RESERVATION_SLOTS];
+};
+
+/**
+ * @brief Struct to store the table shared by the move nodes, empty once initialised by the move node creating it
+ *
+ */
+struct ReservationShared{
+    atomic<uint32_t> initialised; // set once the locks of the cells are initialised
+    ReservationCell cells[RESERVATION_COLUMNS * RESERVATION_ROWS];
+};
+
+/**
+ * @brief Table of the reservations of the workspace, shared by the move nodes of a host
+ *
+ */
+class WorkspaceReservations{
+public:
+    WorkspaceReservations();
+    ~WorkspaceReservations();
+
+    bool open(const string& instance); // Open the table, creating it if no move node did yet
+    bool connected() const; // True if the table is mapped
+    static double now(); // Time on the clock used for the windows [s]
+
+    vector<CellWindow> corridor(Vector3f base, const vector<Vector3f>& points, const vector<double>& earliest, const vector<double>& latest, float radius) const; // Cells swept by the arm and when
+    double conflictEnd(const vector<CellWindow>& windows) const; // End of the windows of the other arms overlapping the windows, lock free
+    bool reserve(const vector<CellWindow>& windows, double& blockedUntil); // Reserve every window replacing the others of this move node, or none
+    void release(); // Release every window of this move node
+
+private:
+    ReservationShared* table;
+    uint64_t owner; // id of this move node in the table
+
+    uint32_t lockCell(int cell); // Lock a cell for writing and return its sequence
+    void unlockCell(int cell, uint32_t sequence);
+    void releaseExcept(const vector<CellWindow>& kept); // Release the windows of this move node outside some cells
+};
+
+/**
+ * @brief Construct a table not opened yet, the owner id is set when it is opened
+ *
+ */
+WorkspaceReservations::WorkspaceReservations(){
+    table = NULL;
+    owner = 0;
+}
+
+/**
+ * @brief Unmap the table, the windows still reserved end by themselves. The table is never removed, the other move nodes may be using it
+ *
+ */
+WorkspaceReservations::~WorkspaceReservations(){
+    if(table) munmap(table, sizeof(ReservationShared));
+}
+
+/**
+ * @brief Time on the monotonic clock, shared by every process of the host [s]
+ *
+ * @return double
+ */
+double WorkspaceReservations::now(){
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Open the table in shared memory, the first move node creates it empty and initialises the locks of the cells
+ *
+ * @param instance name of the move node in its process, its namespace
+ * @return true if the table is mapped
+ */
+bool WorkspaceReservations::open(const string& instance){
+
+    if(!atomic<double>().is_lock_free() || !atomic<uint64_t>().is_lock_free()){
+        cout << "Reservation table needs lock free atomics" << endl;
+        return false;
+    }
+
+    //The process id in the high half, the namespace in the low half, never 0
+    owner = ((uint64_t)getpid() << 32) | ((hash<string>()(instance) & 0x7fffffff) | 0x80000000);
+
+    bool created = true;
+    int fd = shm_open(RESERVATION_TABLE_NAME, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(fd < 0 && errno == EEXIST){
+        created = false;
+        fd = shm_open(RESERVATION_TABLE_NAME, O_RDWR, 0600);
+    }
+    if(fd < 0 || (created && ftruncate(fd, sizeof(ReservationShared)) < 0)){
+        cout << "Cannot open shared memory " << RESERVATION_TABLE_NAME << ": " << strerror(errno) << endl;
+        if(fd >= 0) close(fd);
+        return false;
+    }
+
+    //The move node creating the table may not have resized it yet
+    struct stat status;
+    double since = now();
+    while(!created && fstat(fd, &status) == 0 && status.st_size < sizeof(ReservationShared) && now() - since < RESERVATION_INIT_TIMEOUT)
+        usleep(1000);
+    if(!created && (fstat(fd, &status) < 0 || status.st_size != sizeof(ReservationShared))){
+        cout << "Shared memory " << RESERVATION_TABLE_NAME << " has a different layout, remove it from /dev/shm" << endl;
+        close(fd);
+        return false;
+    }
+
+    void* memory = mmap(NULL, sizeof(ReservationShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(memory == MAP_FAILED) return false;
+    ReservationShared* shared = (ReservationShared*)memory;
+
+    if(created){
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        for(int c = 0; c < RESERVATION_COLUMNS * RESERVATION_ROWS; c++)
+            pthread_mutex_init(&shared->cells[c].lock, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+        shared->initialised.store(1, memory_order_release);
+    }else{
+        since = now();
+        while(!shared->initialised.load(memory_order_acquire) && now() - since < RESERVATION_INIT_TIMEOUT)
+            usleep(1000);
+        if(!shared->initialised.load(memory_order_acquire)){
+            cout << "Shared memory " << RESERVATION_TABLE_NAME << " was never initialised, remove it from /dev/shm" << endl;
+            munmap(memory, sizeof(ReservationShared));
+            return false;
+        }
+    }
+
+    table = shared;
+    return true;
+}
+
+/**
+ * @brief True if the table is mapped
+ *
+ * @return true
+ * @return false
+ */
+bool WorkspaceReservations::connected() const{
+    return table != NULL;
+}
+
+/**
+ * @brief Cells swept by the arm moving from its base through a sequence of points: the cells within a radius of the
+ * triangles between the base and every pair of consecutive points, in ascending order. The window of a cell goes from
+ * the earliest time the arm reaches the first point of a segment sweeping it to the latest time it reaches the last one
+ *
+ * @param base world frame position of the base of the arm
+ * @param points world frame positions reached by the end effector, in order
+ * @param earliest earliest time each point is reached, monotonic clock [s]
+ * @param latest latest time each point is reached, monotonic clock [s]
+ * @param radius distance kept from the arm [m]
+ * @return vector<CellWindow>
+ */
+vector<CellWindow> WorkspaceReservations::corridor(Vector3f base, const vector<Vector3f>& points, const vector<double>& earliest,
+                                                   const vector<double>& latest, float radius) const{
+
+    vector<CellWindow> windows;
+
+    for(int row = 0; row < RESERVATION_ROWS; row++){
+        for(int column = 0; column < RESERVATION_COLUMNS; column++){
+
+            Eigen::Vector2f center(RESERVATION_MIN_X + (column + 0.5) * RESERVATION_CELL, RESERVATION_MIN_Y + (row + 0.5) * RESERVATION_CELL);
+            CellWindow window = {row * RESERVATION_COLUMNS + column, 0, 0};
+
+            for(int i = 0; i + 1 < points.size(); i++){
+                bool swept = false;
+                Eigen::Vector2f vertices[3] = {base.head<2>(), points[i].head<2>(), points[i + 1].head<2>()};
+
+                //Inside the triangle: same side of the three edges
+                float sides[3];
+                for(int e = 0; e < 3; e++){
+                    Eigen::Vector2f edge = vertices[(e + 1) % 3] - vertices[e], toCenter = center - vertices[e];
+                    sides[e] = edge(0) * toCenter(1) - edge(1) * toCenter(0);
+                }
+                if((sides[0] >= 0 && sides[1] >= 0 && sides[2] >= 0) || (sides[0] <= 0 && sides[1] <= 0 && sides[2] <= 0))
+                    swept = true;
+
+                //Within the radius of an edge, the half diagonal covers the cell
+                for(int e = 0; e < 3 && !swept; e++){
+                    Eigen::Vector2f a = vertices[e], b = vertices[(e + 1) % 3];
+                    float length = (b - a).squaredNorm();
+                    float t = length > 0 ? max(0.0f, min(1.0f, (center - a).dot(b - a) / length)) : 0;
+                    if((a + t * (b - a) - center).norm() <= radius + RESERVATION_CELL * M_SQRT1_2)
+                        swept = true;
+                }
+
+                if(!swept) continue;
+                if(window.end == 0 || earliest[i] < window.start) window.start = earliest[i];
+                window.end = max(window.end, latest[i + 1]);
+            }
+
+            if(window.end != 0) windows.push_back(window);
+        }
+    }
+
+    return windows;
+}
+
+/**
+ * @brief Latest end of the windows of the other move nodes overlapping the windows of some cells. The cells are read
+ * without locking, a cell being written is read again
+ *
+ * @param windows
+ * @return double 0 if there are no conflicts
+ */
+double WorkspaceReservations::conflictEnd(const vector<CellWindow>& windows) const{
+
+    double latest = 0;
+
+    for(int i = 0; i < windows.size(); i++){
+        const ReservationCell& cell = table->cells[windows[i].cell];
+        double start = windows[i].start, end = windows[i].end;
+        double cellLatest;
+        uint32_t before, after;
+        int attempts = 0;
+
+        do{
+            before = cell.sequence.load(memory_order_acquire);
+            cellLatest = 0;
+            for(int s = 0; s < RESERVATION_SLOTS; s++){
+                uint64_t slotOwner = cell.slots[s].owner.load(memory_order_relaxed);
+                double slotStart = cell.slots[s].start.load(memory_order_relaxed);
+                double slotEnd = cell.slots[s].end.load(memory_order_relaxed);
+                if(slotOwner != 0 && slotOwner != owner && slotStart < end && slotEnd > start)
+                    cellLatest = max(cellLatest, slotEnd);
+            }
+            atomic_thread_fence(memory_order_acquire);
+            after = cell.sequence.load(memory_order_relaxed);
+        }while(((before & 1) || before != after) && ++attempts < RESERVATION_READ_RETRIES);
+
+        latest = max(latest, cellLatest);
+    }
+
+    return latest;
+}
+
+/**
+ * @brief Lock a cell for writing and make its sequence odd. If the last writer died holding the lock, the cell is made
+ * consistent again: its slots are single atomic fields and the windows it was writing end by themselves
+ *
+ * @param cell
+ * @return uint32_t odd sequence of the locked cell, to pass to unlockCell
+ */
+uint32_t WorkspaceReservations::lockCell(int cell){
+
+    ReservationCell& locked = table->cells[cell];
+    if(pthread_mutex_lock(&locked.lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&locked.lock);
+
+    //A writer that died leaves the sequence odd
+    uint32_t sequence = locked.sequence.load(memory_order_relaxed);
+    if(!(sequence & 1)) sequence++;
+    locked.sequence.store(sequence, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return sequence;
+}
+
+/**
+ * @brief Unlock a cell locked by lockCell
+ *
+ * @param cell
+ * @param sequence
+ */
+void WorkspaceReservations::unlockCell(int cell, uint32_t sequence){
+    table->cells[cell].sequence.store(sequence + 1, memory_order_release);
+    pthread_mutex_unlock(&table->cells[cell].lock);
+}
+
+/**
+ * @brief Reserve the windows of a corridor, only if no other move node holds an overlapping window on any of its cells.
+ * Every other window of this move node is released, on the cells of the corridor it is replaced
+ *
+ * @param windows in ascending order of the cells, as returned by corridor
+ * @param blockedUntil end of the conflicting windows if the corridor is not free [s]
+ * @return true if every window is reserved, false if none is reserved
+ */
+bool WorkspaceReservations::reserve(const vector<CellWindow>& windows, double& blockedUntil){
+
+    vector<uint32_t> sequences(windows.size());
+    vector<int> freeSlot(windows.size(), -1);
+    double current = now();
+    blockedUntil = 0;
+
+    for(int i = 0; i < windows.size(); i++)
+        sequences[i] = lockCell(windows[i].cell);
+
+    //Every cell needs a slot free, expired or already of this move node, and no overlapping window of the others
+    for(int i = 0; i < windows.size(); i++){
+        ReservationCell& cell = table->cells[windows[i].cell];
+        double start = windows[i].start, end = windows[i].end;
+        double earliestEnd = 0;
+        for(int s = 0; s < RESERVATION_SLOTS; s++){
+            uint64_t slotOwner = cell.slots[s].owner.load(memory_order_relaxed);
+            double slotStart = cell.slots[s].start.load(memory_order_relaxed);
+            double slotEnd = cell.slots[s].end.load(memory_order_relaxed);
+
+            if(slotOwner == 0 || slotOwner == owner || slotEnd <= current){
+                if(freeSlot[i] < 0 || slotOwner == owner) freeSlot[i] = s;
+                continue;
+            }
+            if(slotStart < end && slotEnd > start)
+                blockedUntil = max(blockedUntil, slotEnd);
+            if(earliestEnd == 0 || slotEnd < earliestEnd)
+                earliestEnd = slotEnd;
+        }
+        if(freeSlot[i] < 0)
+            blockedUntil = max(blockedUntil, earliestEnd);
+    }
+
+    if(blockedUntil == 0){
+        for(int i = 0; i < windows.size(); i++){
+            ReservationSlot& slot = table->cells[windows[i].cell].slots[freeSlot[i]];
+            slot.owner.store(owner, memory_order_relaxed);
+            slot.start.store(windows[i].start, memory_order_relaxed);
+            slot.end.store(windows[i].end, memory_order_relaxed);
+        }
+    }
+
+    for(int i = windows.size() - 1; i >= 0; i--)
+        unlockCell(windows[i].cell, sequences[i]);
+
+    if(blockedUntil == 0)
+        releaseExcept(windows);
+
+    return blockedUntil == 0;
+}
+
+/**
+ * @brief Release every window of this move node, only the cells where it holds a window are locked
+ *
+ */
+void WorkspaceReservations::release(){
+    releaseExcept(vector<CellWindow>());
+}
+
+/**
+ * @brief Release the windows of this move node on the cells outside a corridor, only the cells where it holds a window are locked
+ *
+ * @param kept windows of the corridor, in ascending order of the cells
+ */
+void WorkspaceReservations::releaseExcept(const vector<CellWindow>& kept){
+
+    int k = 0;
+    for(int c = 0; c < RESERVATION_COLUMNS * RESERVATION_ROWS; c++){
+        ReservationCell& cell = table->cells[c];
+
+        while(k < kept.size() && kept[k].cell < c) k++;
+        if(k < kept.size() && kept[k].cell == c) continue;
+
+        bool owned = false;
+        for(int s = 0; s < RESERVATION_SLOTS; s++)
+            if(cell.slots[s].owner.load(memory_order_relaxed) == owner) owned = true;
+        if(!owned) continue;
+
+        uint32_t sequence = lockCell(c);
+        for(int s = 0; s < RESERVATION_SLOTS; s++)
+            if(cell.slots[s].owner.load(memory_order_relaxed) == owner)
+                cell.slots[s].owner.store(0, memory_order_relaxed);
+        unlockCell(c, sequence);
+    }
+}
@@ -0,0 +1,375 @@
+/**
+ * @file yoloDetector.cpp
+ * @author Matteo Mascherin
+ * @brief File containing the YOLO block detector running on the CPU with OpenCV DNN
+ * @version 1.0
+ * @date 2026-10-17
+ *
+ * @copyright Copyright (c) 2026
+ *
+ * The network is the bestm.pt model of the vision node exported to ONNX, loaded once when the detector is built and
+ * warmed up with a first inference. The letterboxed image and the input blob are kept between the detections: the image
+ * is resized into the letterbox and then written in the blob, in planar RGB scaled to [0, 1], without temporary images.
+ * The output of the network, one column of box and class scores per anchor, is filtered by confidence and by non maximum
+ * suppression like the predict of ultralytics.
+ * The regions of interest of the blocks, when known, are packed at their own scale in rows on the letterbox, so that a
+ * single inference covers all the blocks of the table.
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/dnn.hpp>
+
+using namespace std;
+
+///Default side of the square input of the network [pixel], the one the model was exported with
+#define YOLO_INPUT_SIZE 640
+///Minimum confidence of a detection, default of ultralytics
+#define YOLO_CONFIDENCE 0.25
+///Maximum intersection over union of two detections kept, default of ultralytics
+#define YOLO_IOU 0.7
+///Gray of the padding of the letterbox
+#define LETTERBOX_PADDING 114
+
+/**
+ * @brief Struct to store a block detected in an image
+ *
+ */
+struct Detection{
+    int x, y; // center of the bounding box in the image [pixel]
+    cv::Rect box; // bounding box in the image
+    int blockClass;
+    float confidence;
+};
+
+/**
+ * @brief Struct to store the time spent in each stage of a detection [s]
+ *
+ */
+struct DetectionTiming{
+    double preprocess; // letterbox and blob
+    double inference;
+    double postprocess; // decoding of the boxes and non maximum suppression
+};
+
+/**
+ * @brief Detector of the blocks keeping the network and its buffers between the detections
+ *
+ */
+class YoloDetector{
+public:
+    YoloDetector(const string& model, int inputSize = YOLO_INPUT_SIZE, int threads = 0);
+
+    bool loaded() const; // True if the network was loaded
+    vector<Detection> detect(const cv::Mat& image, DetectionTiming& timing); // Detect the blocks in a BGR or BGRA image
+    vector<Detection> detectPatches(const cv::Mat& image, const vector<cv::Rect>& rois, DetectionTiming& timing); // Detect the blocks in regions of an image
+
+private:
+    cv::dnn::Net net;
+    vector<cv::String> outputNames;
+    int inputSize;
+    float confidence, iou;
+
+    cv::Mat letterbox; // image resized and padded to the input of the network, same channels as the last image
+    cv::Mat blob; // input of the network, 1 x 3 x inputSize x inputSize float
+    vector<cv::Mat> outputs;
+    float scale; // scale from the image to the letterbox
+    int padX, padY; // padding of the letterbox [pixel]
+
+    void preprocess(const cv::Mat& image); // Fill the blob with an image
+    void fillBlob(); // Write the letterbox in the blob
+    void infer(DetectionTiming& timing); // Run the network on the blob
+    vector<Detection> postprocess(int width, int height); // Decode the output of the network
+};
+
+/**
+ * @brief Seconds elapsed since a time point
+ *
+ * @param start
+ * @return double
+ */
+static double secondsSince(chrono::steady_clock::time_point start){
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Load the network on the CPU and run a first inference, so that the first detection does not pay for the
+ * allocation of the layers
+ *
+ * @param model path of the ONNX model
+ * @param inputSize side of the input the model was exported with [pixel]
+ * @param threads threads used by OpenCV, 0 to keep its default
+ */
+YoloDetector::YoloDetector(const string& model, int inputSize, int threads){
+
+    this->inputSize = inputSize;
+    confidence = YOLO_CONFIDENCE;
+    iou = YOLO_IOU;
+    scale = 1;
+    padX = padY = 0;
+
+    if(threads > 0)
+        cv::setNumThreads(threads);
+
+    try{
+        net = cv::dnn::readNetFromONNX(model);
+    }catch(const exception& e){
+        cout << "Failed to load the model " << model << ": " << e.what() << endl;
+        return;
+    }
+    net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+    net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+    outputNames = net.getUnconnectedOutLayersNames();
+
+    int sizes[] = {1, 3, inputSize, inputSize};
+    blob.create(4, sizes, CV_32F);
+
+    //Warm up
+    DetectionTiming timing;
+    detect(cv::Mat(inputSize, inputSize, CV_8UC3, cv::Scalar(LETTERBOX_PADDING, LETTERBOX_PADDING, LETTERBOX_PADDING)), timing);
+    cout << "Model " << model << " loaded, first inference in " << timing.inference * 1000 << " ms" << endl;
+}
+
+/**
+ * @brief True if the network was loaded
+ *
+ * @return bool
+ */
+bool YoloDetector::loaded() const{
+    return !net.empty();
+}
+
+/**
+ * @brief Resize an image into the letterbox, keeping its aspect ratio, and write it in the blob as planar RGB in [0, 1]
+ *
+ * @param image BGR or BGRA image
+ */
+void YoloDetector::preprocess(const cv::Mat& image){
+
+    scale = min((float)inputSize / image.cols, (float)inputSize / image.rows);
+    int width = max(1, (int)(image.cols * scale + 0.5)), height = max(1, (int)(image.rows * scale + 0.5));
+    padX = (inputSize - width) / 2;
+    padY = (inputSize - height) / 2;
+
+    //The letterbox is allocated again only if the channels of the image change, the resize writes in its region
+    letterbox.create(inputSize, inputSize, image.type());
+    letterbox.setTo(cv::Scalar(LETTERBOX_PADDING, LETTERBOX_PADDING, LETTERBOX_PADDING, 0));
+    cv::Mat region = letterbox(cv::Rect(padX, padY, width, height));
+    cv::resize(image, region, cv::Size(width, height), 0, 0, cv::INTER_LINEAR);
+
+    fillBlob();
+}
+
+/**
+ * @brief Write the letterbox in the blob as planar RGB in [0, 1]
+ *
+ */
+void YoloDetector::fillBlob(){
+
+    int channels = letterbox.channels();
+    int plane = inputSize * inputSize;
+    float* red = blob.ptr<float>();
+    float* green = red + plane;
+    float* blue = green + plane;
+
+    for(int r = 0; r < inputSize; r++){
+        const uchar* pixel = letterbox.ptr<uchar>(r);
+        int offset = r * inputSize;
+        for(int c = 0; c < inputSize; c++, pixel += channels){
+            blue[offset + c] = pixel[0] * (1.f / 255);
+            green[offset + c] = pixel[1] * (1.f / 255);
+            red[offset + c] = pixel[2] * (1.f / 255);
+        }
+    }
+}
+
+/**
+ * @brief Decode the output of the network, 4 + classes rows by one column per anchor, into the detections in the
+ * coordinates of the image
+ *
+ * @param width width of the image of the detection, for the clipping of the boxes [pixel]
+ * @param height
+ * @return vector<Detection>
+ */
+vector<Detection> YoloDetector::postprocess(int width, int height){
+
+    vector<Detection> detections;
+    if(outputs.empty() || outputs[0].dims != 3) return detections;
+
+    const cv::Mat& output = outputs[0];
+    int rows = output.size[1], anchors = output.size[2];
+    int classes = rows - 4;
+    if(classes <= 0) return detections;
+
+    const float* data = output.ptr<float>();
+    vector<cv::Rect> boxes;
+    vector<float> scores;
+    vector<int> classIds;
+
+    for(int i = 0; i < anchors; i++){
+        int best = 0;
+        float bestScore = data[4 * anchors + i];
+        for(int k = 1; k < classes; k++){
+            float score = data[(4 + k) * anchors + i];
+            if(score > bestScore){
+                bestScore = score;
+                best = k;
+            }
+        }
+        if(bestScore < confidence) continue;
+
+        //Center and size in the letterbox, to the corners in the image
+        float cx = (data[i] - padX) / scale, cy = (data[anchors + i] - padY) / scale;
+        float w = data[2 * anchors + i] / scale, h = data[3 * anchors + i] / scale;
+        int left = max(0, (int)(cx - w / 2)), top = max(0, (int)(cy - h / 2));
+        int right = min(width, (int)(cx + w / 2)), bottom = min(height, (int)(cy + h / 2));
+        if(right <= left || bottom <= top) continue;
+
+        boxes.push_back(cv::Rect(left, top, right - left, bottom - top));
+        scores.push_back(bestScore);
+        classIds.push_back(best);
+    }
+
+    vector<int> kept;
+    cv::dnn::NMSBoxes(boxes, scores, confidence, iou, kept);
+
+    for(int i = 0; i < kept.size(); i++){
+        const cv::Rect& box = boxes[kept[i]];
+        Detection detection;
+        detection.box = box;
+        detection.x = box.x + box.width / 2;
+        detection.y = box.y + box.height / 2;
+        detection.blockClass = classIds[kept[i]];
+        detection.confidence = scores[kept[i]];
+        detections.push_back(detection);
+    }
+
+    return detections;
+}
+
+/**
+ * @brief Detect the blocks in an image
+ *
+ * @param image BGR or BGRA image
+ * @param timing time spent in each stage
+ * @return vector<Detection> detections with the pixels in the coordinates of the image
+ */
+vector<Detection> YoloDetector::detect(const cv::Mat& image, DetectionTiming& timing){
+
+    timing.preprocess = timing.inference = timing.postprocess = 0;
+    if(!loaded() || image.empty() || image.channels() < 3) return vector<Detection>();
+
+    auto start = chrono::steady_clock::now();
+    preprocess(image);
+    timing.preprocess = secondsSince(start);
+
+    infer(timing);
+
+    start = chrono::steady_clock::now();
+    vector<Detection> detections = postprocess(image.cols, image.rows);
+    timing.postprocess = secondsSince(start);
+
+    return detections;
+}
+
+/**
+ * @brief Run the network on the blob, adding its time to the timing
+ *
+ * @param timing
+ */
+void YoloDetector::infer(DetectionTiming& timing){
+    auto start = chrono::steady_clock::now();
+    net.setInput(blob);
+    net.forward(outputs, outputNames);
+    timing.inference += secondsSince(start);
+}
+
+/**
+ * @brief Detect the blocks in regions of interest of an image. The regions are copied at their own scale in rows on the
+ * letterbox, the ones not fitting go to the next inference; a detection belongs to the region containing its center
+ *
+ * @param image BGR or BGRA image
+ * @param rois regions of interest in the image, the ones larger than the input of the network are skipped
+ * @param timing time spent in each stage, over all the inferences
+ * @return vector<Detection> detections with the pixels in the coordinates of the image
+ */
+vector<Detection> YoloDetector::detectPatches(const cv::Mat& image, const vector<cv::Rect>& rois, DetectionTiming& timing){
+
+    timing.preprocess = timing.inference = timing.postprocess = 0;
+    vector<Detection> detections;
+    if(!loaded() || image.empty() || image.channels() < 3) return detections;
+
+    vector<cv::Rect> pending;
+    for(int i = 0; i < rois.size(); i++){
+        cv::Rect roi = rois[i] & cv::Rect(0, 0, image.cols, image.rows);
+        if(roi.area() > 0 && roi.width <= inputSize && roi.height <= inputSize)
+            pending.push_back(roi);
+    }
+
+    while(!pending.empty()){
+        auto start = chrono::steady_clock::now();
+
+        letterbox.create(inputSize, inputSize, image.type());
+        letterbox.setTo(cv::Scalar(LETTERBOX_PADDING, LETTERBOX_PADDING, LETTERBOX_PADDING, 0));
+        scale = 1;
+        padX = padY = 0;
+
+        //Rows of patches, a region goes to the next row when the current one is full
+        vector<cv::Rect> placed, sources, left;
+        int x = 0, y = 0, rowHeight = 0;
+        for(int i = 0; i < pending.size(); i++){
+            const cv::Rect& roi = pending[i];
+            if(x + roi.width > inputSize){
+                x = 0;
+                y += rowHeight;
+                rowHeight = 0;
+            }
+            if(y + roi.height > inputSize){
+                left.push_back(roi);
+                continue;
+            }
+            cv::Rect target(x, y, roi.width, roi.height);
+            cv::Mat destination = letterbox(target);
+            image(roi).copyTo(destination);
+            placed.push_back(target);
+            sources.push_back(roi);
+            x += roi.width;
+            rowHeight = max(rowHeight, roi.height);
+        }
+        fillBlob();
+        timing.preprocess += secondsSince(start);
+
+        infer(timing);
+
+        start = chrono::steady_clock::now();
+        vector<Detection> packed = postprocess(inputSize, inputSize);
+        for(int i = 0; i < packed.size(); i++){
+            for(int k = 0; k < placed.size(); k++){
+                const cv::Rect& target = placed[k];
+                if(packed[i].x < target.x || packed[i].x >= target.x + target.width || packed[i].y < target.y || packed[i].y >= target.y + target.height)
+                    continue;
+                Detection detection = packed[i];
+                detection.box = detection.box & target;
+                detection.box.x += sources[k].x - target.x;
+                detection.box.y += sources[k].y - target.y;
+                detection.x += sources[k].x - target.x;
+                detection.y += sources[k].y - target.y;
+                detections.push_back(detection);
+                break;
+            }
+        }
+        timing.postprocess += secondsSince(start);
+
+        //A region larger than the free space of an empty letterbox can not be left over
+        if(left.size() == pending.size()) break;
+        pending.swap(left);
+    }
+
+    return detections;
+}
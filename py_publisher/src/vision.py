@@ -6,25 +6,40 @@ import numpy as np
 import rospy
 import sensor_msgs.msg
 from cv_bridge import CvBridge
-from py_publisher.msg import BlockInfo
-from std_msgs.msg import Byte, Int16, Bool
+from py_publisher.msg import BlockInfo, BlockInfoV2, BlockInfoArray
+from std_msgs.msg import Byte, Int16, Bool, Header
 from geometry_msgs.msg import Point
 from sensor_msgs.msg import PointCloud2
 from sensor_msgs import point_cloud2
 import math
+import random
 import message_filters
+try:
+    from cpp_publisher.srv import PointLookup
+except ImportError:
+    PointLookup = None
 
 #Topics
 ZED_LEFT_TOPIC = "/ur5/zed_node/left/image_rect_color"
 ZED_POINT_CLOUD_TOPIC = "/ur5/zed_node/point_cloud/cloud_registered"
 PLANNER_DETECTION_REQUEST_TOPIC = "/planner/detection_request"
+#Service of the C++ node looking up the pixels of the detections in the point cloud
+POINT_LOOKUP_SERVICE = "/vision/point_lookup"
+#Time waited for the service at startup [s]
+POINT_LOOKUP_TIMEOUT = 2
 
 SLEEP_RATE = 10
 
 #Debug mode
 DEBUG = False
-#Set to true if is the real robot
-REAL_ROBOT = False
+
+#Configuration of the camera shared with the C++ nodes, loaded from cpp_publisher/config/camera.yaml
+if not rospy.has_param('/camera/real_robot'):
+    print("Camera configuration not found, load it with: rosparam load $(rospack find cpp_publisher)/config/camera.yaml /camera")
+    raise SystemExit(1)
+#True if is the real robot
+REAL_ROBOT = rospy.get_param('/camera/real_robot')
+CAMERA = rospy.get_param('/camera/real' if REAL_ROBOT else '/camera/simulation')
 
 #Path to the weights used for YOLO
 if REAL_ROBOT:
@@ -45,24 +60,31 @@ MIN_X = 0.05
 MIN_Y = 0.2
 MAX_Y = 0.8
 #Z limits of the blocks on the table
-if REAL_ROBOT:
-    MIN_Z = 0.9
-    MAX_Z = 1.3
-else:
-    MIN_Z = 0.88
-    MAX_Z = 0.92
+MIN_Z, MAX_Z = CAMERA['z_limits']
 
 #Pixel to crop
-if REAL_ROBOT:
-    CROP_HEIGHT = 100
-    CROP_WIDTH = 200
-else:
-    CROP_HEIGHT = 400
-    CROP_WIDTH = 650
+CROP_WIDTH, CROP_HEIGHT = CAMERA['crop']
 
 #Init node and publisher to planner
 rospy.init_node('publisher',anonymous=True)
 pub = rospy.Publisher('vision/vision_detection', BlockInfo, queue_size=10)
+pubArray = rospy.Publisher('vision/vision_detections', BlockInfoArray, queue_size=10)
+
+#Proxy of the point lookup service, None if the point_lookup node is not running
+pointLookup = None
+if PointLookup is not None:
+    try:
+        rospy.wait_for_service(POINT_LOOKUP_SERVICE, timeout=POINT_LOOKUP_TIMEOUT)
+        pointLookup = rospy.ServiceProxy(POINT_LOOKUP_SERVICE, PointLookup, persistent=True)
+    except rospy.ROSException:
+        print("Point lookup service not available, reading the point cloud in Python")
+
+#YOLO model, loaded once for the whole session
+model = YOLO(WEIGHT)
+
+#Trace ids of the detections: random prefix of the session and counter of the detections
+TRACE_SESSION = random.getrandbits(32) << 32
+traceCounter = 0
 
 """
 Function that publishes the message to the planner if it is subscribed
@@ -81,6 +103,20 @@ def talker(msg):
     else:
         print("No subscribers")
 
+"""
+Function that publishes every block detected in a frame to the planner if it is subscribed
+@param msg: array message to publish to planner
+"""
+def talkerArray(msg):
+
+    global pubArray
+
+    if pubArray.get_num_connections() > 0:
+        print("Publishing %d blocks" % len(msg.blocks))
+        pubArray.publish(msg)
+    else:
+        print("No subscribers for batch detections")
+
 """
 Function that builds the custom message to be published
 @param block: dictionary with the block info
@@ -97,6 +133,50 @@ def buildMsg(block):
 
     return msg
 
+"""
+Function that returns a new trace id, unique across the sessions, that follows a detection through planner and move node
+@return traceId: 64 bit trace id
+"""
+def nextTraceId():
+
+    global traceCounter
+
+    traceCounter += 1
+    return TRACE_SESSION | traceCounter
+
+"""
+Function that builds the versioned message of a block, with the stamp of its frame and a new trace id
+@param block: dictionary with the block info
+@param header: header of the frame the block was detected in
+@return msg: versioned message of the block
+"""
+def buildMsgV2(block, header):
+
+    msg = BlockInfoV2()
+    msg.header = header
+    msg.blockId = block['id']
+    msg.traceId = nextTraceId()
+    msg.blockClass = block['class']
+    msg.blockPosition = Point(block['x'] + 0.02, block['y'], block['z'])
+    msg.confidence = block['confidence']
+
+    return msg
+
+"""
+Function that builds the message with every block detected in a frame
+@param blockList: list of dictionary with the blocks info
+@param stamp: timestamp of the frame the blocks were detected in
+@return msg: array message to be published
+"""
+def buildArrayMsg(blockList, stamp):
+
+    msg = BlockInfoArray()
+    msg.header = Header(stamp=stamp, frame_id='world')
+    for block in blockList:
+        msg.blocks.append(buildMsgV2(block, msg.header))
+
+    return msg
+
 """
 Function that given a pointcloud and a list of blocks and their corresponding pixel, returns the coordinates of the blocks in the world frame
 Checks also if the point is on the table
@@ -109,6 +189,7 @@ def receivePointcloud(msg, list):
     block = {
         'id': list['id'],
         'class': list['class'],
+        'confidence': list['confidence'],
         'x': 0,
         'y': 0,
         'z': 0
@@ -122,18 +203,9 @@ def receivePointcloud(msg, list):
         points_list.append([data[0], data[1], data[2]]) #coordinates in the camera frame
 
     #Transform from camera frame to world frame
-    base_offset = [0.5,0.35,1.75]
-
-    if REAL_ROBOT:
-        x_c = [-0.9, 0.18, -0.35] #oldZ = 0.49948
-        rotation = np.array([[0.86632, 0., 0.49948],
-                             [0., 1., 0.],
-                             [-0.49948, 0., 0.86632]])
-    else:
-        x_c = [-0.9,0.24,-0.35]
-        rotation = np.array([[0., -0.49948, 0.86632],
-                             [-1., 0., 0.],
-                             [-0., -0.86632, -0.49948]])
+    base_offset = CAMERA['base_offset']
+    x_c = CAMERA['camera_offset']
+    rotation = np.array(CAMERA['rotation']).reshape(3, 3)
     
     #Coordinates in the world frame
     pointW = rotation.dot(points_list[0]) + x_c + base_offset
@@ -141,27 +213,75 @@ def receivePointcloud(msg, list):
 
     #Check if the point is a NaN
     if not (math.isnan(pointW[0]) and math.isnan(pointW[1]) and math.isnan(pointW[2])):
-        if REAL_ROBOT:
-            block['x'] = pointW[0] - 0.015 #Calibration fixing
-            block['y'] = pointW[1] - 0.02
-            block['z'] = pointW[2]
-        else:
-            block['x'] = pointW[0] - 0.02
-            block['y'] = pointW[1]
-            block['z'] = pointW[2]
+        #Calibration fixing
+        block['x'] = pointW[0] + CAMERA['correction'][0]
+        block['y'] = pointW[1] + CAMERA['correction'][1]
+        block['z'] = pointW[2] + CAMERA['correction'][2]
     else:
         print("Not a number")
 
     #Check if the point is on the table
-    if block['z'] >= MIN_Z and block['z'] <= MAX_Z and block['x'] >= MIN_X and block['x'] <= MAX_X and block['y'] > MIN_Y and block['y'] < MAX_Y:
+    if onTable(block):
         return block
     else:
         return None
 
 """
-Function that given a detection result returns the center of the bounding box drawn by YOLO and the class of the block
+Function that checks if a block in the world frame is on the table
+@param block: dictionary with the coordinates of the block in the world frame
+@return True if the block is inside the limits of the table
+"""
+def onTable(block):
+    return block['z'] >= MIN_Z and block['z'] <= MAX_Z and block['x'] >= MIN_X and block['x'] <= MAX_X and block['y'] > MIN_Y and block['y'] < MAX_Y
+
+"""
+Function that given a pointcloud and a list of blocks and their corresponding pixel, returns the blocks on the table with their coordinates
+in the world frame. All the pixels are looked up by the point_lookup node with a single service call, the pointcloud is read in Python
+only if the service is not available
+@param pointCloud: pointcloud message
+@param blockList: list of dictionary of blocks with their corresponding pixel
+@return blockListCoord: list of dictionary of blocks on the table with their coordinates in the world frame
+"""
+def lookupBlocks(pointCloud, blockList):
+    global pointLookup
+
+    if pointLookup is not None and len(blockList) > 0:
+        try:
+            #Add the cropped pixels to match the pointcloud
+            response = pointLookup(pointCloud.header.stamp,
+                                   [b['x'] + CROP_WIDTH for b in blockList],
+                                   [b['y'] + CROP_HEIGHT for b in blockList])
+            blockListCoord = []
+            for i in range(len(blockList)):
+                if not response.valid[i]:
+                    print("Not a number")
+                    continue
+                block = {
+                    'id': blockList[i]['id'],
+                    'class': blockList[i]['class'],
+                    'confidence': blockList[i]['confidence'],
+                    'x': response.points[i].x,
+                    'y': response.points[i].y,
+                    'z': response.points[i].z
+                }
+                if onTable(block):
+                    blockListCoord.append(block)
+            return blockListCoord
+        except (rospy.ServiceException, rospy.ROSException) as e:
+            print("Point lookup failed, reading the point cloud in Python: ", e)
+            pointLookup = None
+
+    blockListCoord = []
+    for i in range(len(blockList)):
+        block = receivePointcloud(pointCloud, blockList[i])
+        if block != None: #check z limits
+            blockListCoord.append(block)
+    return blockListCoord
+
+"""
+Function that given a detection result returns the center of the bounding box drawn by YOLO, the class of the block and the confidence of the detection
 @param result: detection result from YOLO
-@return info: dictionary with the center of the bounding box and the class of the block
+@return info: dictionary with the center of the bounding box, the class of the block and its confidence
 """
 def findCenter(result):
 
@@ -174,10 +294,12 @@ def findCenter(result):
     y = int((y1 + y2) / 2)
 
     blockClass = int(result.boxes.cls.tolist()[0])
+    confidence = float(result.boxes.conf.tolist()[0])
 
     info = {
         'id': 0,
         'class': blockClass,
+        'confidence': confidence,
         'x': x,
         'y': y
     }
@@ -190,9 +312,6 @@ Function that given an image calls YOLO to detect blocks than calls findCenter()
 @return blockList: list of dictionary of blocks with their corresponding pixel
 """
 def detect(image):
-    #Get weights
-    model = YOLO(WEIGHT)
-
     if REAL_ROBOT:
         #Convert image from 4 to 3 channels
         b, g, r, a = cv2.split(image)
@@ -255,14 +374,15 @@ def callback(img, pointCloud):
         # cv2.waitKey(0)
 
         #Get coordinates from x,y pixels
-        blocklListCoord = []
-        for i in range(len(blockList)):
-            block = receivePointcloud(pointCloud, blockList[i])
-            if block != None: #check z limits
-                blocklListCoord.append(block)
+        blocklListCoord = lookupBlocks(pointCloud, blockList)
 
         # print("block:\n", block)
 
+        #Publish every block on the table for the planner work queue
+        for i in range(len(blocklListCoord)):
+            blocklListCoord[i]['id'] = i
+        talkerArray(buildArrayMsg(blocklListCoord, pointCloud.header.stamp))
+
         #Keep only the nearest block to the camera
         if len(blocklListCoord) > 1: #If more than one block detected
             block = min(blocklListCoord, key=lambda x: x['x'])